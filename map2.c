@@ -1,196 +1,2804 @@
-#include "map2.h"
-
-#define DBG_MODULE "map2"
-#include "shared/dbg.h"
-
-/**
-	Macros assert
-	
-	Exemplos:
-		
-		MAP2_ASSERT(ptr == NULL, return false);
-		MAP2_ASSERT(ptr == NULL, return);
-		MAP2_ASSERT(ptr == NULL, {
-			printr("null ptr");
-			return false;
-		});
-	
-	
-*/
-#define MAP2_ASSERT(cond, ret)		if (cond) ret;
-
-/**
-	Definies para habilitar mensagens de debug
-	
-	@def MAP2_CONFIG_DBG_WAIT Habilita mensagem quando aguardar mutex
-	@def MAP2_CONFIG_DBG_TIMEOUT Habilita mensagem de timeout no mutex
-	@def MAP2_CONFIG_DBG_TAKE Habilita mensagem de uso do mutex
-	@def MAP2_CONFIG_DBG_DROP Habilita mensagem de liberao do mutex
-*/
-#define MAP2_CONFIG_DBG_WAIT
-#define MAP2_CONFIG_DBG_TIMEOUT
-#define MAP2_CONFIG_DBG_TAKE
-#define MAP2_CONFIG_DBG_DROP
-
-/**
-	@def map2_ptr Ponteiro um campo no mapa
-	@def map2_val Valor de um campo no mapa
-	@def map2_pos Clculo de posio pela linha e coluna
-	
-	Os dados sempre so organizados como um vetor simples, como se
-	houvesse apenas uma linha (a menos que algum muito estranho acontea):
-	[r0-c0][r0-c1][r0-c2] [r1-c0][r1-c1][r1-c2] [r2-c0][r2-c1][r2-c2]
-	Tudo isso alinhado conforme a arquitetura
-	Assim, podemos fazer o acesso ao mapa atravs de um ponteiro simples
-*/
-#define map2_ptr(var, pos, type)	(type*)((uint32_t)var + pos)
-#define map2_val(var, pos, type)	*map2_ptr(var, pos, type)
-#define map2_pos(m, row, column)	((column + (m->columns * row)) * m->field_size)
-
-
-/**
-	@brief Retorna a posio da chave de acesso com base na configurao do mapa
-	
-	@param m Endereo do mapa
-	@param row Posio do item na linha
-	
-	@note A posio indica o acesso conforme os canais configurados em hardware,
-	como descrito na tabela abaixo:
-	
-		NKYES / Retorno		0		1		2
-		MAP2_NKEYS_1		T		X		X
-		MAP2_NKEYS_2		P		I		X
-		MAP2_NKEYS_3		P		I		E
-	
-	Legenda:
-		T= Todos os canais
-		P= Canais pares
-		I= Canais mpares
-		E= Canais expanso
-		X= Invlido
-		
-	@note Vlido somente se UART_INSTANCES == 2 para canais da placa base (pares
-	e mpares) e, instncia simples para os canais de expanso
-	
-	@note Para ser usado com map2_readonly*() ou map2_readwrite*() para 
-	selecionar a chave de acesso
-	
-	Exemplo:
-		int key = map2_key(&my_map1, c);
-		t_t data_ro = {0};
-		map2_readonly_trycatch(&my_map1, c, n, key, data_ro, 2000, {
-			...
-		},{
-			...
-		});
-	
-*/
-int map2_key(const map2_t *m, int row) {
-	MAP2_ASSERT(m == NULL, return 0);
-	MAP2_ASSERT(row < 0 || row >= m->rows, return 0);
-	
-	if (m->keys == MAP2_NKEYS_1)
-		return 0;
-	else if (m->keys == MAP2_NKEYS_3 && row >= SLOT_CNT * SLOT_CH)
-		return 2;
-	else
-		return row % UART_INSTANCES == 0 ? 0 : 1;
-}
-
-/**
-	@brief Inicializao dos mutex do mapa
-	
-	@param m Endereo do mapa
-*/
-void __map2_init(const map2_t *m) {
-	MAP2_ASSERT(m == NULL, return);
-	
-	for (int k = 0; k < m->keys; k++)
-		os_mut_init((void*)map2_ptr(m->mut, k, void));
-}
-
-/**
-	@brief Liberao de mutex para acesso ao mapa
-	
-	@param m Endereo do mapa
-	@param row Posio do item na linha
-	@param column Posio do item na coluna
-	@param key Poisio da chave de acesso
-*/
-void __map2_drop(const map2_t *m, int row, int column, int key) {
-	MAP2_ASSERT(m == NULL, return);
-	MAP2_ASSERT(row < 0 || row >= m->rows || column < 0 || column >= m->columns, return);
-	MAP2_ASSERT(key < 0 || key >= m->keys, return);
-	
-	#ifdef MAP2_CONFIG_DBG_DROP
-		dbgW("Drop row:%d column:%d key:%d task:%d\n", row, column, key, os_tsk_self());
-	#endif
-	
-	os_mut_release(map2_ptr(m->mut, key, void));
-}
-
-/**
-	@brief Aguarda e aloca mutex para acesso ao mapa
-	
-	@param m Endereo do mapa
-	@param row Posio do item na linha
-	@param column Posio do item na coluna
-	@param key Poisio da chave de acesso
-	@param dst Item (destido onde os dados do item sero copiados)
-	@param tout Timeout de acesso
-	@param op Modo de operao
-
-	@return Ponteiro para o item ou, NULL quando ocorrer erro no acesso
-*/
-void *__map2_take(const map2_t *m, int row, int column, int key, void *dst, uint32_t tout, map2_operation_t op) {
-	MAP2_ASSERT(m == NULL, return NULL);
-	MAP2_ASSERT(row < 0 || row >= m->rows || column < 0 || column >= m->columns, return NULL);
-	MAP2_ASSERT(key < 0 || key >= m->keys, return NULL);
-	
-	// Previne que o timeout seja maior ou igual ao valor mximo do RTOS
-	// Quando timeout  0xFFFF o RTOS assume que o tempo  infinito, fazendo 
-	// os_mut_wait() a tarefa aguardar o mutex para sempre
-	if (tout >= 0xFFFF)
-		tout -= 1;
-	
-	#ifdef MAP2_CONFIG_DBG_WAIT
-		dbgW("Wait row:%d column:%d key:%d task:%d timeout:%d op:%d\n", row, column, key, os_tsk_self(), tout, op);
-	#endif
-	
-	#ifndef MAP2_CONFIG_MUT_DISABLE
-		if (os_mut_wait(map2_ptr(m->mut, key, void), tout) == OS_R_TMO) {
-			#ifdef MAP2_CONFIG_DBG_TIMEOUT
-				dbgW("Timeout row:%d column:%d key:%d task:%d timeout:%d\n", row, column, key, os_tsk_self(), tout);
-			#endif
-			return NULL;
-		}
-	#endif
-	
-	void *src = map2_ptr(m->data, map2_pos(m, row, column), void);
-	
-	#ifdef MAP2_CONFIG_DBG_TAKE
-		dbgW("Take row:%d column:%d key:%d task:%d %s\n", row, column, key, os_tsk_self(), src == NULL ? "null-ptr" : "");
-	#endif
-	
-	if (op == MAP2_OP_READONLY) {
-		// Cpia dos dados para uso no modo somente leitura
-		// Isso garante que os dados alterados em 'field' no so replicados
-		// para o mapa
-		if (dst != NULL && src != NULL)
-			memcpy(dst, src, m->field_size);
-	}
-	else {
-		// Modo leitura e escrita, apenas aponta 'field' para o mapa, assim,
-		// o acesso  diretamente no mapa
-		dst = src;
-	}
-	
-	if (dst == NULL || op == MAP2_OP_READONLY) {
-		// Qualquer erro libera o mutex
-		// Como vamos usar map2_readonly() ou map2_readwrite(), no precisamos
-		// se preocupar com liberar o mutex em caso de erro
-		__map2_drop(m, row, column, key);
-	}
-	
-	return dst;
-}
+#include "map2.h"
+
+#define DBG_MODULE "map2"
+#include "shared/dbg.h"
+
+/**
+	Definições para habilitar mensagens de debug
+	
+	@def MAP2_CONFIG_DBG_WAIT Habilita mensagem quando aguardar mutex
+	@def MAP2_CONFIG_DBG_TIMEOUT Habilita mensagem de timeout no mutex
+	@def MAP2_CONFIG_DBG_TAKE Habilita mensagem de uso do mutex
+	@def MAP2_CONFIG_DBG_DROP Habilita mensagem de liberação do mutex
+*/
+#define MAP2_CONFIG_DBG_WAIT
+#define MAP2_CONFIG_DBG_TIMEOUT
+#define MAP2_CONFIG_DBG_TAKE
+#define MAP2_CONFIG_DBG_DROP
+
+/**
+	@def MAP2_FUTEX_WAIT Aguarda enquanto '*PTR == VAL', no máximo TICKS ticks
+	@def MAP2_FUTEX_WAKE Acorda uma tarefa aguardando em PTR
+	@def MAP2_CONFIG_TICK_US Duração de um tick em microssegundos (host)
+	
+	No host (Linux) é utilizado futex. Nas demais plataformas, e no simulador
+	(MAP2_CONFIG_SIM), a tarefa aguarda 1 tick e tenta novamente, podendo ser
+	redefinido, por exemplo, com eventos do RTOS
+*/
+#ifndef MAP2_CONFIG_TICK_US
+#define MAP2_CONFIG_TICK_US		(1000)
+#endif
+
+#if !defined(MAP2_FUTEX_WAIT) && defined(__linux__) && !defined(MAP2_CONFIG_SIM)
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static void __map2_futex_wait(uint32_t *l, uint32_t val, uint32_t ticks) {
+	uint64_t us = (uint64_t)ticks * MAP2_CONFIG_TICK_US;
+	struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+	
+	syscall(SYS_futex, l, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+#define MAP2_FUTEX_WAIT(PTR, VAL, TICKS)	__map2_futex_wait((PTR), (VAL), (TICKS))
+#define MAP2_FUTEX_WAKE(PTR)				syscall(SYS_futex, (PTR), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0)
+#endif
+
+#ifndef MAP2_FUTEX_WAIT
+#define MAP2_FUTEX_WAIT(PTR, VAL, TICKS)	MAP2_OS_DELAY(1)
+#define MAP2_FUTEX_WAKE(PTR)				((void)(PTR))
+#endif
+
+/**
+	@def MAP2_TIMESTAMP Instante atual para as estatísticas de latência
+	@def MAP2_CONFIG_STATS_DEADLINE Prazo para aguardar a chave, em unidades de
+	MAP2_TIMESTAMP()
+	
+	No host é utilizado CLOCK_MONOTONIC em nanossegundos. No RTOS e no
+	simulador (MAP2_CONFIG_SIM) o padrão é o tick (os_time_get), podendo ser
+	redefinido, por exemplo, com DWT->CYCCNT
+	
+	@note Apenas a diferença entre dois instantes é utilizada, logo o estouro
+	do contador de 32 bits não é um problema
+*/
+#if !defined(MAP2_TIMESTAMP) && defined(__linux__) && !defined(MAP2_CONFIG_SIM)
+#include <time.h>
+
+static inline uint32_t __map2_timestamp(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+}
+
+#define MAP2_TIMESTAMP()	__map2_timestamp()
+#endif
+
+#ifndef MAP2_TIMESTAMP
+#define MAP2_TIMESTAMP()	os_time_get()
+#endif
+
+#ifndef MAP2_CONFIG_STATS_DEADLINE
+#define MAP2_CONFIG_STATS_DEADLINE	(0xFFFFFFFFu)
+#endif
+
+/**
+	@def MAP2_CONFIG_USDT Pontos de rastreamento estáticos (USDT) no host, para
+	uso com perf e bpftrace sem recompilar ou habilitar as mensagens de debug
+	@def MAP2_TRACE Dispara um ponto de rastreamento
+	@def MAP2_TRACE_ENABLED Indica se há um rastreador conectado ao ponto
+	
+	Pontos disponíveis (provedor 'map2'):
+		wait		map, name, key, row, column, op, tout
+		acquired	map, name, key, row, column, op, wait, stamp
+		timeout		map, name, key, row, column, op, wait
+		released	map, name, key, row, column, stamp
+		copy		map, name, row, column, size
+	
+	Os tempos estão em unidades de MAP2_TIMESTAMP() e só são medidos quando há
+	um rastreador conectado (semáforos USDT). O tempo com a chave alocada é a
+	diferença entre 'stamp' de released e de acquired da mesma chave. Acessos
+	a uma linha inteira utilizam 'column' -1
+	
+	Exemplo:
+		bpftrace -e 'usdt:./gateway:map2:acquired { @wait[str(arg1)] = hist(arg6); }'
+	
+	@note Requer sys/sdt.h (systemtap-sdt-dev). Sem MAP2_CONFIG_USDT os pontos
+	não geram código
+*/
+#ifdef MAP2_CONFIG_USDT
+#define _SDT_HAS_SEMAPHORES	1
+#include <sys/sdt.h>
+
+#define MAP2_TRACE_SEMAPHORE(probe)	\
+	unsigned short map2_##probe##_semaphore __attribute__((unused, section(".probes")))
+
+MAP2_TRACE_SEMAPHORE(wait);
+MAP2_TRACE_SEMAPHORE(acquired);
+MAP2_TRACE_SEMAPHORE(timeout);
+MAP2_TRACE_SEMAPHORE(released);
+MAP2_TRACE_SEMAPHORE(copy);
+
+#define MAP2_TRACE_ENABLED(probe)	__builtin_expect(map2_##probe##_semaphore != 0, 0)
+#define MAP2_TRACE(probe, ...)		STAP_PROBEV(map2, probe, __VA_ARGS__)
+#else
+#define MAP2_TRACE_ENABLED(probe)	(0)
+#define MAP2_TRACE(probe, ...)
+#endif
+
+/**
+	@def MAP2_CONFIG_REGISTRY_MAX Quantidade máxima de mapas registrados
+*/
+#ifndef MAP2_CONFIG_REGISTRY_MAX
+#define MAP2_CONFIG_REGISTRY_MAX	(32)
+#endif
+
+static const map2_t *__map2_registry[MAP2_CONFIG_REGISTRY_MAX];
+static uint32_t __map2_registry_count;		/** Posições publicadas */
+static uint32_t __map2_registry_reserved;	/** Posições reservadas */
+
+/**
+	@def MAP2_CONFIG_CELL_SPIN Tentativas de obter a trava por item antes de
+	aguardar ticks do RTOS
+*/
+#ifndef MAP2_CONFIG_CELL_SPIN
+#define MAP2_CONFIG_CELL_SPIN	(64)
+#endif
+
+/**
+	@brief Política de chaves conforme os canais configurados em hardware
+	
+	@param km Política de chaves
+	@param row Posição do item na linha
+	@param keys Quantidade de chaves do mapa
+	
+	@return Posição da chave, conforme a tabela abaixo:
+	
+		NKYES / Retorno		0		1		2
+		MAP2_NKEYS_1		T		X		X
+		MAP2_NKEYS_2		P		I		X
+		MAP2_NKEYS_3		P		I		E
+	
+	Legenda:
+		T= Todos os canais
+		P= Canais pares
+		I= Canais ímpares
+		E= Canais expansão
+		X= Inválido
+		
+	@note Válido somente se UART_INSTANCES == 2 para canais da placa base (pares
+	e ímpares) e, instância simples para os canais de expansão
+*/
+int map2_keymap_slots(const map2_keymap_t *km, int row, int keys) {
+	(void)km;
+	
+	if (keys == MAP2_NKEYS_1)
+		return 0;
+	else if (keys == MAP2_NKEYS_3 && row >= SLOT_CNT * SLOT_CH)
+		return 2;
+	else
+		return row % UART_INSTANCES == 0 ? 0 : 1;
+}
+
+/**
+	@brief Política de chaves alternadas (linha % chaves)
+*/
+int map2_keymap_modulo(const map2_keymap_t *km, int row, int keys) {
+	(void)km;
+	return row % keys;
+}
+
+/**
+	@brief Política de chaves por faixas contíguas de 'km->arg' linhas
+*/
+int map2_keymap_range(const map2_keymap_t *km, int row, int keys) {
+	(void)keys;
+	MAP2_ASSERT(km->arg <= 0, return -1);
+	return row / km->arg;
+}
+
+/**
+	@brief Política de chaves espalhadas por hash multiplicativo
+	
+	@note Evita que linhas vizinhas, normalmente utilizadas pela mesma tarefa,
+	fiquem sempre na mesma chave
+*/
+int map2_keymap_hash(const map2_keymap_t *km, int row, int keys) {
+	(void)km;
+	return (int)((((uint32_t)row * 2654435761u) >> 16) % (uint32_t)keys);
+}
+
+/**
+	@brief Política de chaves definida pela tabela 'km->table'
+	
+	@note A tabela deve possuir uma posição para cada linha do mapa
+*/
+int map2_keymap_table(const map2_keymap_t *km, int row, int keys) {
+	(void)keys;
+	MAP2_ASSERT(km->table == NULL, return -1);
+	return km->table[row];
+}
+
+/**
+	@brief Política de chaves de MAP2_ADAPTIVE(..), definida pela tabela
+	'km->table' com a chave + 1 de cada linha
+	
+	@note A tabela zerada distribui as linhas entre as 'km->arg' chaves
+	iniciais, como em MAP2_KEYMAP_MODULO(), sem inicialização
+*/
+int map2_keymap_adaptive(const map2_keymap_t *km, int row, int keys) {
+	MAP2_ASSERT(km->table == NULL, return -1);
+	return km->table[row] != 0 ? km->table[row] - 1 : row % (km->arg > 0 && km->arg < keys ? km->arg : keys);
+}
+
+/**
+	@brief Retorna a posição da chave de acesso com base na configuração do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	
+	@return Posição da chave ou, -1 quando a linha é inválida
+	
+	@note A chave é definida pela política do mapa (MAP2_KEYMAP(..)), por padrão
+	map2_keymap_slots(..)
+	
+	@note Para ser usado com map2_readonly*() ou map2_readwrite*() para 
+	selecionar a chave de acesso. Uma chave inválida faz o acesso executar 'err'
+	
+	Exemplo:
+		int key = map2_key(&my_map1, c);
+		t_t data_ro = {0};
+		map2_readonly_trycatch(&my_map1, c, n, key, data_ro, 2000, {
+			...
+		},{
+			...
+		});
+	
+*/
+int map2_key(const map2_t *m, int row) {
+	MAP2_ASSERT(m == NULL, return -1);
+	MAP2_ASSERT(row < 0 || row >= m->rows, return -1);
+	
+	if (m->keymap == NULL)
+		return map2_keymap_slots(NULL, row, m->keys);
+	
+	int key = m->keymap->key(m->keymap, row, m->keys);
+	
+	return key >= 0 && key < m->keys ? key : -1;
+}
+
+/**
+	@brief Verifica se todas as linhas do mapa possuem chave de acesso válida
+	
+	@param m Endereço do mapa
+	
+	@return true quando todas as linhas possuem chave válida
+*/
+bool map2_keymap_check(const map2_t *m) {
+	MAP2_ASSERT(m == NULL, return false);
+	
+	for (int r = 0; r < m->rows; r++) {
+		if (map2_key(m, r) < 0) {
+			dbgW("Invalid key row:%d keys:%d\n", r, m->keys);
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+/**
+	Estados da inicialização de um mapa, ver __map2_init(..)
+	
+	@def MAP2_READY_NONE Mapa ainda não inicializado (estado zerado)
+	@def MAP2_READY_BUSY Inicialização em andamento por outra tarefa
+	@def MAP2_READY_DONE Mapa inicializado
+*/
+#define MAP2_READY_NONE		(0)
+#define MAP2_READY_BUSY		(1)
+#define MAP2_READY_DONE		(2)
+
+/**
+	@brief Inicialização dos mutex e registro do mapa
+*/
+static void __map2_setup(const map2_t *m) {
+	int index = 0;
+	
+	// O mapa permanece no registro em uma nova inicialização
+	while (index < map2_registry_count() && MAP2_ATOMIC_LOAD(&__map2_registry[index]) != m)
+		index++;
+	
+	if (index == map2_registry_count()) {
+		uint32_t i = MAP2_ATOMIC_FETCH_ADD(&__map2_registry_reserved, 1);
+		
+		index = (int)i;
+		if (i < MAP2_CONFIG_REGISTRY_MAX)
+			MAP2_ATOMIC_STORE(&__map2_registry[i], m);
+		else
+			dbgW("Registry full name:%s\n", m->name != NULL ? m->name : "");
+		
+		// Publica as posições em ordem, map2_registry_get(..) nunca retorna
+		// NULL para uma posição contada
+		for (int spin = 0; MAP2_ATOMIC_LOAD(&__map2_registry_count) != i; spin++) {
+			if (spin < MAP2_CONFIG_CELL_SPIN)
+				MAP2_CPU_RELAX();
+			else
+				MAP2_OS_DELAY(1);
+		}
+		
+		MAP2_ATOMIC_STORE(&__map2_registry_count, i + 1);
+	}
+	
+	// Posição utilizada nos registros de acesso (MAP2_CONFIG_RECORD)
+	if (m->ready != NULL && index < MAP2_CONFIG_REGISTRY_MAX)
+		m->ready->index = (uint32_t)index + 1;
+	
+	map2_keymap_check(m);
+	
+	MAP2_ASSERT(m->mut == NULL, return);
+	
+	for (int k = 0; k < m->keys; k++)
+		os_mut_init(map2_mut(m, k));
+}
+
+/**
+	@brief Inicialização dos mutex do mapa, executada uma única vez
+	
+	@param m Endereço do mapa
+	
+	Chamada por map2_init(..) ou, no primeiro acesso ao mapa. A tarefa que
+	altera 'ready->state' de MAP2_READY_NONE para MAP2_READY_BUSY inicializa o mapa,
+	as demais aguardam MAP2_READY_DONE
+	
+	@note Também verifica a política de chaves com map2_keymap_check(..), uma
+	linha sem chave válida gera mensagem de debug
+	
+	@note Chamadas seguintes não inicializam os mutex novamente, evitando
+	reiniciar um mutex alocado por outra tarefa
+*/
+void __map2_init(const map2_t *m) {
+	MAP2_ASSERT(m == NULL, return);
+	
+	if (m->ready == NULL) {
+		__map2_setup(m);
+		return;
+	}
+	
+	uint32_t state = MAP2_READY_NONE;
+	
+	if (MAP2_ATOMIC_CAS(&m->ready->state, &state, MAP2_READY_BUSY)) {
+		__map2_setup(m);
+		MAP2_ATOMIC_STORE(&m->ready->state, MAP2_READY_DONE);
+		return;
+	}
+	
+	// Aguarda 1 tick depois de algumas tentativas, permitindo que uma tarefa
+	// de menor prioridade termine a inicialização
+	for (int spin = 0; MAP2_ATOMIC_LOAD(&m->ready->state) != MAP2_READY_DONE; spin++) {
+		if (spin < MAP2_CONFIG_CELL_SPIN)
+			MAP2_CPU_RELAX();
+		else
+			MAP2_OS_DELAY(1);
+	}
+}
+
+/**
+	@brief Aguarda e aloca a trava de um item (MAP2_CELL)
+	
+	@param l Trava do item
+	@param tout Timeout de acesso
+	@param contended Indica se a trava estava ocupada
+	
+	@return true quando a trava foi alocada
+*/
+static bool __map2_cell_lock(map2_cell_lock_t *l, uint32_t tout, bool *contended) {
+	for (int spin = 0;; spin++) {
+		map2_cell_lock_t exp = 0;
+		
+		// Apenas leitura enquanto ocupada, evitando invalidar o cache da trava
+		if (MAP2_ATOMIC_LOAD(l) == 0 && MAP2_ATOMIC_CAS(l, &exp, 1))
+			return true;
+		
+		*contended = true;
+		
+		if (spin < MAP2_CONFIG_CELL_SPIN) {
+			for (int n = 1 << (spin < 6 ? spin : 6); n > 0; n--)
+				MAP2_CPU_RELAX();
+		}
+		else {
+			// Libera o processador, a tarefa que possui a trava pode ter
+			// prioridade menor
+			if (tout == 0)
+				return false;
+			MAP2_OS_DELAY(1);
+			tout--;
+		}
+	}
+}
+
+/**
+	@brief Aguarda e aloca a trava de todas as colunas de uma linha (MAP2_CELL)
+	
+	@param m Endereço do mapa
+	@param row Posição da linha
+	@param tout Timeout de acesso, um único prazo para todas as colunas
+	@param contended Indica se alguma trava estava ocupada
+	
+	@return true quando todas as travas foram alocadas
+	
+	@note As colunas são alocadas em ordem crescente, assim duas tarefas não
+	ficam aguardando uma a outra. Em caso de erro as colunas já alocadas são
+	liberadas
+*/
+static bool __map2_cell_lock_row(const map2_t *m, int row, uint32_t tout, bool *contended) {
+	map2_cell_lock_t *l = &m->lck[m->columns * row];
+	uint32_t start = os_time_get();
+	uint32_t left = tout;
+	
+	for (int c = 0; c < m->columns; c++) {
+		bool busy = false;
+		
+		if (!__map2_cell_lock(&l[c], left, &busy)) {
+			while (--c >= 0)
+				MAP2_ATOMIC_STORE(&l[c], 0);
+			return false;
+		}
+		
+		// O prazo só é recalculado quando a coluna precisou aguardar
+		if (busy) {
+			uint32_t elapsed = os_time_get() - start;
+			
+			*contended = true;
+			left = elapsed < tout ? tout - elapsed : 0;
+		}
+	}
+	
+	return true;
+}
+
+/**
+	@brief Posição de um valor no histograma
+	
+	@param v Valor
+	
+	@return Posição, ver map2_hist_t
+*/
+static int __map2_hist_index(uint32_t v) {
+	const int sub = MAP2_CONFIG_HIST_SUB;
+	
+	if (v < (1u << sub))
+		return (int)v;
+	
+	int e = 31 - __builtin_clz(v);
+	
+	return ((e - sub + 1) << sub) + (int)((v >> (e - sub)) & ((1u << sub) - 1));
+}
+
+/**
+	@brief Adiciona um valor ao histograma
+	
+	@param h Histograma
+	@param v Valor
+	
+	@note Seguro para uso concorrente, o contador é incrementado atomicamente
+*/
+void map2_hist_add(map2_hist_t *h, uint32_t v) {
+	MAP2_ASSERT(h == NULL, return);
+	
+	MAP2_ATOMIC_FETCH_ADD(&h->count[__map2_hist_index(v)], 1);
+}
+
+#ifdef MAP2_CONFIG_CHECK
+/**
+	Quantidade de violações de exclusão mútua, ver map2_owner_t
+*/
+static uint32_t __map2_check_violations;
+
+/**
+	@brief Registra uma violação de exclusão mútua
+	
+	@note Os campos de map2_owner_t são lidos antes da chave ser alocada,
+	assim todos os acessos são atômicos
+*/
+#define __map2_check_fail(msg, m, key, o) \
+	do { \
+		MAP2_ATOMIC_FETCH_ADD(&__map2_check_violations, 1); \
+		dbgW("Check %s data:%p key:%d task:%d owner:%d depth:%d\n", msg, (m)->data, key, os_tsk_self(), \
+			MAP2_ATOMIC_LOAD(&(o)->task), MAP2_ATOMIC_LOAD(&(o)->depth)); \
+	} while (0)
+
+/**
+	@brief Verifica a chave antes de aguardar
+	
+	@return false quando a tarefa já possui a trava rápida, aguardar causaria
+	deadlock
+*/
+static bool __map2_check_wait(const map2_t *m, int key) {
+	map2_owner_t *o = &m->owner[key];
+	
+	if (m->fast != NULL && MAP2_ATOMIC_LOAD(&o->depth) > 0 && MAP2_ATOMIC_LOAD(&o->task) == os_tsk_self()) {
+		__map2_check_fail("recursive", m, key, o);
+		return false;
+	}
+	
+	return true;
+}
+
+/**
+	@brief Verifica a chave após alocar, nenhuma outra tarefa pode possuí-la
+*/
+static void __map2_check_take(const map2_t *m, int key) {
+	map2_owner_t *o = &m->owner[key];
+	uint32_t depth = MAP2_ATOMIC_LOAD(&o->depth);
+	
+	if (depth > 0 && MAP2_ATOMIC_LOAD(&o->task) != os_tsk_self())
+		__map2_check_fail("shared", m, key, o);
+	
+	MAP2_ATOMIC_STORE(&o->task, os_tsk_self());
+	MAP2_ATOMIC_STORE(&o->depth, depth + 1);
+}
+
+/**
+	@brief Verifica a chave antes de liberar, somente o dono pode liberar
+*/
+static void __map2_check_drop(const map2_t *m, int key) {
+	map2_owner_t *o = &m->owner[key];
+	uint32_t depth = MAP2_ATOMIC_LOAD(&o->depth);
+	
+	if (depth == 0 || MAP2_ATOMIC_LOAD(&o->task) != os_tsk_self()) {
+		__map2_check_fail("not owner", m, key, o);
+		return;
+	}
+	
+	if (depth == 1)
+		MAP2_ATOMIC_STORE(&o->task, 0);
+	MAP2_ATOMIC_STORE(&o->depth, depth - 1);
+}
+#endif
+
+/**
+	@brief Quantidade de violações de exclusão mútua detectadas
+	
+	@return Quantidade de violações ou, 0 sem MAP2_CONFIG_CHECK
+*/
+uint32_t map2_check_violations(void) {
+	#ifdef MAP2_CONFIG_CHECK
+		return MAP2_ATOMIC_LOAD(&__map2_check_violations);
+	#else
+		return 0;
+	#endif
+}
+
+#ifdef MAP2_CONFIG_SAMPLE
+/**
+	@def MAP2_CONFIG_SAMPLE_DEPTH Posições do buffer de amostras (potência de 2)
+	@def MAP2_CONFIG_SAMPLE_EVERY Intervalo padrão entre amostras
+	@def MAP2_CONFIG_SAMPLE_WAIT Tempo aguardando a chave a partir do qual o
+	acesso sempre é registrado, padrão desabilitado (0)
+*/
+#ifndef MAP2_CONFIG_SAMPLE_DEPTH
+#define MAP2_CONFIG_SAMPLE_DEPTH	(256)
+#endif
+
+#ifndef MAP2_CONFIG_SAMPLE_EVERY
+#define MAP2_CONFIG_SAMPLE_EVERY	(1024)
+#endif
+
+#ifndef MAP2_CONFIG_SAMPLE_WAIT
+#define MAP2_CONFIG_SAMPLE_WAIT		(0)
+#endif
+
+static map2_sample_t __map2_samples[MAP2_CONFIG_SAMPLE_DEPTH];
+static uint32_t __map2_sample_head;
+static uint32_t __map2_sample_every = MAP2_CONFIG_SAMPLE_EVERY;
+static uint32_t __map2_sample_wait = MAP2_CONFIG_SAMPLE_WAIT;
+
+/**
+	@brief Decide, antes de aguardar a chave, se o acesso será amostrado
+	
+	@param m Endereço do mapa
+	@param key Posição da chave de acesso
+	
+	@return true quando o acesso completa o intervalo de amostragem da chave
+	
+	@note A contagem é por chave, sem operação atômica de leitura e escrita.
+	Tarefas que aguardam a mesma chave podem perder um decremento, o que
+	apenas aumenta o intervalo entre amostras
+*/
+static bool __map2_sample_pick(const map2_t *m, int key) {
+	uint32_t every = MAP2_ATOMIC_LOAD(&__map2_sample_every);
+	
+	if (every == 0 || m->sample == NULL)
+		return false;
+	
+	uint32_t *countdown = &m->sample[key].countdown;
+	uint32_t n = MAP2_ATOMIC_LOAD(countdown);
+	
+	// Intervalo reduzido por map2_sample_config() reinicia a contagem
+	if (n > 1 && n <= every) {
+		MAP2_ATOMIC_STORE(countdown, n - 1);
+		return false;
+	}
+	
+	MAP2_ATOMIC_STORE(countdown, every);
+	return true;
+}
+
+/**
+	@brief Registra a amostra de um acesso alocado
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna, -1 para a linha inteira
+	@param key Posição da chave de acesso
+	@param op Modo de operação
+	@param site Endereço de onde o acesso foi requisitado
+	@param start Instante em que o acesso foi requisitado
+	@param wait Tempo aguardando a chave a partir do qual a amostra é
+	registrada, 0 sempre registra
+	
+	Quando o mapa possui chaves a amostra fica pendente até a liberação da
+	chave, ver __map2_sample_drop(..)
+*/
+static void __map2_sample_take(const map2_t *m, int row, int column, int key, map2_operation_t op, const void *site, uint32_t start, uint32_t wait) {
+	uint32_t now = MAP2_TIMESTAMP();
+	
+	if (wait != 0 && now - start < wait)
+		return;
+	
+	uint32_t idx = MAP2_ATOMIC_FETCH_ADD(&__map2_sample_head, 1);
+	map2_sample_t *s = &__map2_samples[idx & (MAP2_CONFIG_SAMPLE_DEPTH - 1)];
+	
+	// Seqlock: 0 durante a escrita, leitores descartam a cópia
+	MAP2_ATOMIC_STORE(&s->seq, 0);
+	MAP2_ATOMIC_FENCE();
+	
+	s->index = idx;
+	s->site = (uintptr_t)site;
+	s->map = m;
+	s->row = row;
+	s->column = column;
+	s->key = (int8_t)key;
+	s->op = (uint8_t)op;
+	s->stamp = now;
+	s->wait = now - start;
+	s->hold = 0;
+	
+	// A chave protege a amostra pendente até __map2_sample_drop()
+	if (m->sample != NULL && m->lck == NULL)
+		m->sample[key].pending = idx + 1;
+	else
+		MAP2_ATOMIC_STORE(&s->seq, idx + 1);
+}
+
+/**
+	@brief Conclui a amostra pendente de uma chave, registrando o tempo com a
+	chave alocada
+	
+	@param m Endereço do mapa
+	@param key Posição da chave de acesso
+	
+	@note Se a posição do buffer foi reutilizada enquanto a chave estava
+	alocada a amostra é descartada
+*/
+static void __map2_sample_drop(const map2_t *m, int key) {
+	if (m->sample == NULL || m->sample[key].pending == 0)
+		return;
+	
+	uint32_t idx = m->sample[key].pending - 1;
+	map2_sample_t *s = &__map2_samples[idx & (MAP2_CONFIG_SAMPLE_DEPTH - 1)];
+	
+	m->sample[key].pending = 0;
+	
+	if (s->index != idx)
+		return;
+	
+	s->hold = MAP2_TIMESTAMP() - s->stamp;
+	MAP2_ATOMIC_STORE(&s->seq, idx + 1);
+}
+#endif
+
+#ifdef MAP2_CONFIG_RECORD
+/**
+	@def MAP2_CONFIG_RECORD_DEPTH Posições do buffer de registros (potência de 2)
+*/
+#ifndef MAP2_CONFIG_RECORD_DEPTH
+#define MAP2_CONFIG_RECORD_DEPTH	(1024)
+#endif
+
+// A posição do mapa é gravada em 8 bits, 0xFF indica mapa não registrado
+_Static_assert(MAP2_CONFIG_REGISTRY_MAX <= 0xFF, "MAP2_CONFIG_RECORD: MAP2_CONFIG_REGISTRY_MAX must be at most 255");
+
+/**
+	Posição do buffer de registros
+*/
+typedef struct {
+	uint32_t seq;			/** Índice + 1 quando completo, 0 durante a escrita */
+	uint32_t index;			/** Índice do registro no buffer */
+	map2_record_t rec;
+}
+map2_record_slot_t;
+
+static map2_record_slot_t __map2_records[MAP2_CONFIG_RECORD_DEPTH];
+static uint32_t __map2_record_head;
+static bool __map2_record_on;
+
+/**
+	@brief Registra um acesso alocado
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna, -1 para a linha inteira
+	@param key Posição da chave de acesso
+	@param op Modo de operação
+	
+	Quando o mapa possui chaves o registro fica pendente até a liberação da
+	chave, ver __map2_record_drop(..)
+*/
+static void __map2_record_take(const map2_t *m, int row, int column, int key, map2_operation_t op) {
+	if (!MAP2_ATOMIC_LOAD(&__map2_record_on))
+		return;
+	
+	uint32_t idx = MAP2_ATOMIC_FETCH_ADD(&__map2_record_head, 1);
+	map2_record_slot_t *s = &__map2_records[idx & (MAP2_CONFIG_RECORD_DEPTH - 1)];
+	
+	// Posição no registro, 0xFF quando o mapa não foi registrado
+	uint32_t map = m->ready != NULL && m->ready->index != 0 ? m->ready->index - 1 : 0xFF;
+	
+	// Seqlock: 0 durante a escrita, leitores descartam a cópia
+	MAP2_ATOMIC_STORE(&s->seq, 0);
+	MAP2_ATOMIC_FENCE();
+	
+	s->index = idx;
+	s->rec.stamp = MAP2_TIMESTAMP();
+	s->rec.hold = 0;
+	s->rec.task = (uint16_t)os_tsk_self();
+	s->rec.map = (uint8_t)map;
+	s->rec.op = (uint8_t)op;
+	s->rec.row = row;
+	s->rec.column = column;
+	
+	// A chave protege o registro pendente até __map2_record_drop()
+	if (m->record != NULL && m->lck == NULL)
+		m->record[key] = idx + 1;
+	else
+		MAP2_ATOMIC_STORE(&s->seq, idx + 1);
+}
+
+/**
+	@brief Conclui o registro pendente de uma chave, registrando o tempo com a
+	chave alocada
+	
+	@param m Endereço do mapa
+	@param key Posição da chave de acesso
+	
+	@note Se a posição do buffer foi reutilizada enquanto a chave estava
+	alocada o registro é descartado
+*/
+static void __map2_record_drop(const map2_t *m, int key) {
+	if (m->record == NULL || m->record[key] == 0)
+		return;
+	
+	uint32_t idx = m->record[key] - 1;
+	map2_record_slot_t *s = &__map2_records[idx & (MAP2_CONFIG_RECORD_DEPTH - 1)];
+	
+	m->record[key] = 0;
+	
+	if (s->index != idx)
+		return;
+	
+	s->rec.hold = MAP2_TIMESTAMP() - s->rec.stamp;
+	MAP2_ATOMIC_STORE(&s->seq, idx + 1);
+}
+#endif
+
+/**
+	@brief Habilita a gravação de acessos
+	
+	@param enable true para gravar todos os acessos alocados
+	
+	@note Sem efeito sem MAP2_CONFIG_RECORD
+*/
+void map2_record_enable(bool enable) {
+	#ifdef MAP2_CONFIG_RECORD
+		MAP2_ATOMIC_STORE(&__map2_record_on, enable);
+	#else
+		(void)enable;
+	#endif
+}
+
+/**
+	@brief Lê os acessos gravados
+	
+	@param cursor Índice do próximo registro a ser lido, iniciar com 0.
+	Atualizado a cada leitura
+	@param records Destino dos registros
+	@param max Quantidade máxima de registros
+	
+	@return Quantidade de registros copiados
+	
+	Registros sobrescritos antes da leitura são perdidos, registros em escrita
+	ou pendentes são ignorados, assim a leitura deve ser frequente o suficiente
+	para acompanhar a taxa de acessos
+	
+	Exemplo:
+		static uint32_t cursor;
+		map2_record_t r[64];
+		int n = map2_record_read(&cursor, r, 64);
+*/
+int map2_record_read(uint32_t *cursor, map2_record_t *records, int max) {
+	MAP2_ASSERT(cursor == NULL || records == NULL || max <= 0, return 0);
+	
+	#ifdef MAP2_CONFIG_RECORD
+		uint32_t head = MAP2_ATOMIC_LOAD(&__map2_record_head);
+		int n = 0;
+		
+		if (head - *cursor > MAP2_CONFIG_RECORD_DEPTH)
+			*cursor = head - MAP2_CONFIG_RECORD_DEPTH;
+		
+		for (; *cursor != head && n < max; (*cursor)++) {
+			map2_record_slot_t *s = &__map2_records[*cursor & (MAP2_CONFIG_RECORD_DEPTH - 1)];
+			uint32_t seq = MAP2_ATOMIC_LOAD(&s->seq);
+			
+			if (seq != *cursor + 1)
+				continue;
+			
+			records[n] = s->rec;
+			MAP2_ATOMIC_FENCE();
+			
+			// Descarta se a posição foi reutilizada durante a cópia
+			if (MAP2_ATOMIC_LOAD(&s->seq) == seq)
+				n++;
+		}
+		
+		return n;
+	#else
+		return 0;
+	#endif
+}
+
+/**
+	@brief Configura a amostragem de acessos
+	
+	@param every Intervalo entre amostras, 0 desabilita
+	@param wait Tempo aguardando a chave, em unidades de MAP2_TIMESTAMP(), a
+	partir do qual o acesso sempre é registrado, 0 desabilita
+	
+	@note Sem efeito sem MAP2_CONFIG_SAMPLE
+*/
+void map2_sample_config(uint32_t every, uint32_t wait) {
+	#ifdef MAP2_CONFIG_SAMPLE
+		MAP2_ATOMIC_STORE(&__map2_sample_every, every);
+		MAP2_ATOMIC_STORE(&__map2_sample_wait, wait);
+	#else
+		(void)every;
+		(void)wait;
+	#endif
+}
+
+/**
+	@brief Lê as amostras registradas
+	
+	@param cursor Índice da próxima amostra a ser lida, iniciar com 0.
+	Atualizado a cada leitura
+	@param samples Destino das amostras
+	@param max Quantidade máxima de amostras
+	
+	@return Quantidade de amostras copiadas
+	
+	Amostras sobrescritas antes da leitura são perdidas, amostras em escrita
+	ou pendentes são ignoradas. Não utiliza trava, pode ser chamada por
+	qualquer tarefa enquanto o mapa é utilizado
+	
+	Exemplo:
+		static uint32_t cursor;
+		map2_sample_t s[32];
+		int n = map2_sample_read(&cursor, s, 32);
+*/
+int map2_sample_read(uint32_t *cursor, map2_sample_t *samples, int max) {
+	MAP2_ASSERT(cursor == NULL || samples == NULL || max <= 0, return 0);
+	
+	#ifdef MAP2_CONFIG_SAMPLE
+		uint32_t head = MAP2_ATOMIC_LOAD(&__map2_sample_head);
+		int n = 0;
+		
+		if (head - *cursor > MAP2_CONFIG_SAMPLE_DEPTH)
+			*cursor = head - MAP2_CONFIG_SAMPLE_DEPTH;
+		
+		for (; *cursor != head && n < max; (*cursor)++) {
+			map2_sample_t *s = &__map2_samples[*cursor & (MAP2_CONFIG_SAMPLE_DEPTH - 1)];
+			uint32_t seq = MAP2_ATOMIC_LOAD(&s->seq);
+			
+			if (seq != *cursor + 1)
+				continue;
+			
+			samples[n] = *s;
+			MAP2_ATOMIC_FENCE();
+			
+			// Descarta se a posição foi reutilizada durante a cópia
+			if (MAP2_ATOMIC_LOAD(&s->seq) == seq)
+				n++;
+		}
+		
+		return n;
+	#else
+		return 0;
+	#endif
+}
+
+/**
+	@brief Aguarda e aloca uma trava rápida (MAP2_FAST)
+	
+	@param l Trava da chave
+	@param tout Timeout de acesso
+	@param contended Indica se a trava estava ocupada
+	
+	@return true quando a trava foi alocada
+	
+	Estados da trava: 0 livre, 1 ocupada, 2 ocupada com tarefas aguardando.
+	A tarefa que libera a trava no estado 2 acorda uma tarefa aguardando
+*/
+static bool __map2_fast_lock(uint32_t *l, uint32_t tout, bool *contended) {
+	uint32_t c = 0;
+	
+	if (MAP2_ATOMIC_CAS(l, &c, 1))
+		return true;
+	
+	*contended = true;
+	
+	uint32_t start = os_time_get();
+	
+	while (MAP2_ATOMIC_XCHG(l, 2) != 0) {
+		uint32_t elapsed = os_time_get() - start;
+		
+		if (elapsed >= tout)
+			return false;
+		MAP2_FUTEX_WAIT(l, 2, tout - elapsed);
+	}
+	
+	return true;
+}
+
+/**
+	@brief Aguarda e aloca o acesso a um item do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna, -1 para todas as colunas da
+	linha em mapas com trava por item
+	@param key Poisição da chave de acesso
+	@param tout Timeout de acesso
+	
+	@return true quando o acesso foi alocado
+	
+	@note As estatísticas contam uma aquisição por chamada, também quando
+	'column' é -1
+*/
+static bool __map2_lock(const map2_t *m, int row, int column, int key, uint32_t tout) {
+	bool contended = false;
+	bool ok = true;
+	
+	// Inicialização no primeiro acesso, map2_init(..) é opcional
+	if (m->ready != NULL && MAP2_ATOMIC_LOAD(&m->ready->state) != MAP2_READY_DONE)
+		__map2_init(m);
+	
+	#ifdef MAP2_CONFIG_STATS_HIST
+		uint32_t start = MAP2_TIMESTAMP();
+	#endif
+	
+	#ifdef MAP2_CONFIG_CHECK
+		if (m->owner != NULL && !__map2_check_wait(m, key))
+			return false;
+	#endif
+	
+	if (m->lck != NULL && column < 0) {
+		ok = __map2_cell_lock_row(m, row, tout, &contended);
+	}
+	else if (m->lck != NULL) {
+		ok = __map2_cell_lock(&m->lck[column + m->columns * row], tout, &contended);
+	}
+	else if (m->fast != NULL) {
+		ok = __map2_fast_lock(&m->fast[key], tout, &contended);
+	}
+	else if (m->mut != NULL) {
+		#if !defined(MAP2_CONFIG_MUT_DISABLE) && defined(MAP2_CONFIG_STATS)
+			// Tentativa sem aguardar, identifica se a chave está em disputa
+			contended = os_mut_wait(map2_mut(m, key), 0) == OS_R_TMO;
+			ok = !contended || os_mut_wait(map2_mut(m, key), tout) != OS_R_TMO;
+		#elif !defined(MAP2_CONFIG_MUT_DISABLE)
+			ok = os_mut_wait(map2_mut(m, key), tout) != OS_R_TMO;
+		#endif
+	}
+	
+	#ifdef MAP2_CONFIG_STATS
+		if (m->stats != NULL) {
+			map2_stats_t *s = &m->stats[key];
+			
+			MAP2_ATOMIC_FETCH_ADD(ok ? &s->acquisitions : &s->timeouts, 1);
+			if (ok && contended)
+				MAP2_ATOMIC_FETCH_ADD(&s->contended, 1);
+			
+			#ifdef MAP2_CONFIG_STATS_HIST
+				if (ok) {
+					uint32_t now = MAP2_TIMESTAMP();
+					
+					map2_hist_add(&s->wait, now - start);
+					if (now - start > MAP2_CONFIG_STATS_DEADLINE)
+						MAP2_ATOMIC_FETCH_ADD(&s->late, 1);
+					if (m->lck == NULL)
+						s->taken = now;
+				}
+			#endif
+		}
+		
+		// A linha pertence à chave alocada, não é necessário acesso atômico
+		if (m->adapt != NULL && ok && contended)
+			m->adapt->hits[row]++;
+	#endif
+	
+	#ifdef MAP2_CONFIG_CHECK
+		if (m->owner != NULL && ok)
+			__map2_check_take(m, key);
+	#endif
+	
+	return ok;
+}
+
+/**
+	@brief Libera o acesso a um item do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+*/
+static void __map2_unlock(const map2_t *m, int row, int column, int key) {
+	if (m->lck != NULL) {
+		MAP2_ATOMIC_STORE(&m->lck[column + m->columns * row], 0);
+		return;
+	}
+	
+	#ifdef MAP2_CONFIG_STATS_HIST
+		if (m->stats != NULL)
+			map2_hist_add(&m->stats[key].hold, MAP2_TIMESTAMP() - m->stats[key].taken);
+	#endif
+	
+	#ifdef MAP2_CONFIG_CHECK
+		if (m->owner != NULL)
+			__map2_check_drop(m, key);
+	#endif
+	
+	if (m->fast != NULL) {
+		if (MAP2_ATOMIC_XCHG(&m->fast[key], 0) == 2)
+			MAP2_FUTEX_WAKE(&m->fast[key]);
+		return;
+	}
+	
+	#ifndef MAP2_CONFIG_MUT_DISABLE
+		if (m->mut != NULL)
+			os_mut_release(map2_mut(m, key));
+	#endif
+}
+
+/**
+	@brief Aguarda e aloca o acesso a todas as colunas de uma linha do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição da linha
+	@param key Poisição da chave de acesso
+	@param tout Timeout de acesso
+	
+	@return true quando o acesso foi alocado
+	
+	@note Com trava por item todas as colunas são alocadas dentro de um único
+	timeout, ver __map2_cell_lock_row(..)
+*/
+static bool __map2_lock_row(const map2_t *m, int row, int key, uint32_t tout) {
+	return __map2_lock(m, row, m->lck != NULL ? -1 : 0, key, tout);
+}
+
+/**
+	@brief Libera o acesso a todas as colunas de uma linha do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição da linha
+	@param key Poisição da chave de acesso
+*/
+static void __map2_unlock_row(const map2_t *m, int row, int key) {
+	if (m->lck == NULL) {
+		__map2_unlock(m, row, 0, key);
+		return;
+	}
+	
+	for (int c = m->columns - 1; c >= 0; c--)
+		__map2_unlock(m, row, c, key);
+}
+
+/**
+	@brief Pausa do leitor enquanto um item é escrito (seqlock ímpar)
+	
+	@param spin Quantidade de tentativas já realizadas
+	
+	Depois de MAP2_CONFIG_CELL_SPIN tentativas aguarda 1 tick, permitindo que
+	o escritor de menor prioridade, preemptado durante a escrita, termine
+*/
+static void __map2_seq_wait(int spin) {
+	if (spin < MAP2_CONFIG_CELL_SPIN)
+		MAP2_CPU_RELAX();
+	else
+		MAP2_OS_DELAY(1);
+}
+
+/**
+	@brief Grava o valor atual de um item no histórico (MAP2_HISTORY)
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	
+	@note A chave do item deve estar alocada, apenas uma tarefa escreve no
+	histórico de um item por vez
+*/
+static void __map2_history_put(const map2_t *m, int row, int column) {
+	map2_history_t *h = m->history;
+	size_t cell = (size_t)row * (size_t)m->columns + (size_t)column;
+	uint32_t seq = h->seq[cell];
+	uint32_t *e = &h->ring[(cell * h->depth + (seq / 2) % h->depth) * h->words];
+	const uint8_t *item = map2_ptr(m->data, map2_pos(m, row, column), uint8_t);
+	
+	// Seqlock: ímpar durante a escrita, leitores descartam a cópia
+	MAP2_ATOMIC_STORE(&h->seq[cell], seq + 1);
+	MAP2_ATOMIC_FENCE();
+	
+	e[0] = MAP2_TIMESTAMP();
+	memcpy(&e[1], item + h->field.offset, h->field.size != 0 ? h->field.size : m->field_size);
+	
+	MAP2_ATOMIC_STORE(&h->seq[cell], seq + 2);
+}
+
+/**
+	@brief Avança as janelas de um item até o tick atual
+	
+	@param w Estatísticas por janela do mapa
+	@param c Estado do item, copiado ou protegido pela chave
+	@param now Tick atual
+*/
+static void __map2_window_roll(const map2_window_t *w, map2_window_cell_t *c, uint32_t now) {
+	uint32_t elapsed = now - c->start;
+	
+	if (elapsed < w->window)
+		return;
+	
+	if (elapsed < 2 * w->window) {
+		c->min[1] = c->min[0];
+		c->max[1] = c->max[0];
+		c->count[1] = c->count[0];
+	}
+	else {
+		c->count[1] = 0;
+	}
+	
+	c->count[0] = 0;
+	c->start += w->window * (elapsed / w->window);
+}
+
+/**
+	@brief Adiciona o valor atual de um item às estatísticas por janela
+	
+	@note A chave do item deve estar alocada
+*/
+static void __map2_window_put(const map2_t *m, int row, int column) {
+	const map2_window_t *w = m->window;
+	map2_window_cell_t *c = &w->cells[(size_t)row * (size_t)m->columns + (size_t)column];
+	int32_t v = w->get(map2_ptr(m->data, map2_pos(m, row, column), void));
+	uint32_t seq = c->seq;
+	
+	MAP2_ATOMIC_STORE(&c->seq, seq + 1);
+	MAP2_ATOMIC_FENCE();
+	
+	__map2_window_roll(w, c, os_time_get());
+	
+	if (c->count[0] == 0 || v < c->min[0])
+		c->min[0] = v;
+	if (c->count[0] == 0 || v > c->max[0])
+		c->max[0] = v;
+	
+	// Média em Q8, o primeiro valor inicia a média
+	if (seq == 0)
+		c->ema = (int64_t)v * 256;
+	else
+		c->ema += ((int64_t)v * 256 - c->ema) >> w->shift;
+	
+	c->last = v;
+	c->count[0]++;
+	
+	MAP2_ATOMIC_STORE(&c->seq, seq + 2);
+}
+
+/**
+	@brief Registra a escrita de um item: histórico (MAP2_HISTORY),
+	estatísticas por janela (MAP2_WINDOW) e instante da última escrita
+	(MAP2_CONFIG_STAMP)
+	
+	@note A chave do item deve estar alocada
+*/
+static void __map2_written(const map2_t *m, int row, int column) {
+	if (m->history != NULL)
+		__map2_history_put(m, row, column);
+	
+	if (m->window != NULL)
+		__map2_window_put(m, row, column);
+	
+	if (m->stamp != NULL) {
+		uint32_t now = os_time_get();
+		MAP2_ATOMIC_STORE(&m->stamp[(size_t)row * (size_t)m->columns + (size_t)column], now != 0 ? now : 1);
+	}
+}
+
+/**
+	@brief Liberação da chave sem registrar escrita, utilizada nos acessos
+	somente leitura
+*/
+static void __map2_release(const map2_t *m, int row, int column, int key) {
+	#ifdef MAP2_CONFIG_DBG_DROP
+		dbgW("Drop row:%d column:%d key:%d task:%d\n", row, column, key, os_tsk_self());
+	#endif
+	
+	#ifdef MAP2_CONFIG_SAMPLE
+		__map2_sample_drop(m, key);
+	#endif
+	
+	#ifdef MAP2_CONFIG_RECORD
+		__map2_record_drop(m, key);
+	#endif
+	
+	__map2_unlock(m, row, column, key);
+	
+	MAP2_TRACE(released, m, m->name, key, row, column, MAP2_TRACE_ENABLED(released) ? MAP2_TIMESTAMP() : 0);
+}
+
+/**
+	@brief Liberação de mutex para acesso ao mapa
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	
+	@note O acesso é considerado uma escrita, o valor do item é gravado no
+	histórico (MAP2_HISTORY) e o instante da escrita é atualizado
+	(MAP2_CONFIG_STAMP)
+*/
+void __map2_drop(const map2_t *m, int row, int column, int key) {
+	MAP2_ASSERT(m == NULL, return);
+	MAP2_ASSERT(row < 0 || row >= m->rows || column < 0 || column >= m->columns, return);
+	MAP2_ASSERT(key < 0 || key >= m->keys, return);
+	
+	__map2_written(m, row, column);
+	__map2_release(m, row, column, key);
+}
+
+/**
+	@brief Aguarda e aloca a chave de um item, com as estatísticas, amostras,
+	registros e pontos de rastreamento do acesso
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param tout Timeout de acesso
+	@param op Modo de operação registrado
+	@param site Endereço de onde o acesso foi requisitado (MAP2_CONFIG_SAMPLE)
+	
+	@return Ponteiro para o item no mapa, com a chave alocada, ou NULL quando
+	ocorrer erro no acesso
+	
+	@note A chave permanece alocada independente de 'op', leituras que não
+	copiam o item inteiro (map2_project(..)) utilizam MAP2_OP_READONLY e
+	liberam a chave com __map2_release(..)
+*/
+static void *__map2_acquire(const map2_t *m, int row, int column, int key, uint32_t tout, map2_operation_t op, const void *site) {
+	MAP2_ASSERT(m == NULL, return NULL);
+	MAP2_ASSERT(row < 0 || row >= m->rows || column < 0 || column >= m->columns, return NULL);
+	MAP2_ASSERT(key < 0 || key >= m->keys, return NULL);
+	
+	// Previne que o timeout seja maior ou igual ao valor máximo do RTOS
+	// Quando timeout é 0xFFFF o RTOS assume que o tempo é infinito, fazendo 
+	// os_mut_wait() a tarefa aguardar o mutex para sempre
+	if (tout >= 0xFFFF)
+		tout -= 1;
+	
+	#ifdef MAP2_CONFIG_DBG_WAIT
+		dbgW("Wait row:%d column:%d key:%d task:%d timeout:%d op:%d\n", row, column, key, os_tsk_self(), tout, op);
+	#endif
+	
+	(void)op;
+	(void)site;
+	
+	#ifdef MAP2_CONFIG_SAMPLE
+		// O instante só é lido quando o acesso pode ser registrado
+		bool sample = __map2_sample_pick(m, key);
+		uint32_t wait = sample ? 0 : MAP2_ATOMIC_LOAD(&__map2_sample_wait);
+		uint32_t start = sample || wait != 0 ? MAP2_TIMESTAMP() : 0;
+	#endif
+	
+	#ifdef MAP2_CONFIG_USDT
+		uint32_t trace = MAP2_TRACE_ENABLED(acquired) || MAP2_TRACE_ENABLED(timeout) ? MAP2_TIMESTAMP() : 0;
+	#endif
+	
+	MAP2_TRACE(wait, m, m->name, key, row, column, op, tout);
+	
+	if (!__map2_lock(m, row, column, key, tout)) {
+		#ifdef MAP2_CONFIG_DBG_TIMEOUT
+			dbgW("Timeout row:%d column:%d key:%d task:%d timeout:%d\n", row, column, key, os_tsk_self(), tout);
+		#endif
+		MAP2_TRACE(timeout, m, m->name, key, row, column, op, MAP2_TRACE_ENABLED(timeout) ? MAP2_TIMESTAMP() - trace : 0);
+		return NULL;
+	}
+	
+	#ifdef MAP2_CONFIG_USDT
+		if (MAP2_TRACE_ENABLED(acquired)) {
+			uint32_t now = MAP2_TIMESTAMP();
+			MAP2_TRACE(acquired, m, m->name, key, row, column, op, now - trace, now);
+		}
+	#endif
+	
+	#ifdef MAP2_CONFIG_SAMPLE
+		if (sample || wait != 0)
+			__map2_sample_take(m, row, column, key, op, site, start, wait);
+	#endif
+	
+	#ifdef MAP2_CONFIG_RECORD
+		__map2_record_take(m, row, column, key, op);
+	#endif
+	
+	void *src = map2_ptr(m->data, map2_pos(m, row, column), void);
+	
+	#ifdef MAP2_CONFIG_DBG_TAKE
+		dbgW("Take row:%d column:%d key:%d task:%d %s\n", row, column, key, os_tsk_self(), src == NULL ? "null-ptr" : "");
+	#endif
+	
+	return src;
+}
+
+/**
+	@brief Aguarda e aloca mutex para acesso ao mapa
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param dst Item (destido onde os dados do item serão copiados)
+	@param tout Timeout de acesso
+	@param op Modo de operação
+
+	@return Ponteiro para o item ou, NULL quando ocorrer erro no acesso
+*/
+void *__map2_take(const map2_t *m, int row, int column, int key, void *dst, uint32_t tout, map2_operation_t op) {
+	// Endereço de retorno, dentro da função que utilizou map2_readonly*()
+	// ou map2_readwrite*()
+	// Itens indiretos são trocados apenas com map2_indirect_put(..), que
+	// mantém as referências dos blocos
+	MAP2_ASSERT(m != NULL && m->slab != NULL && op == MAP2_OP_READWRITE, return NULL);
+	
+	void *src = __map2_acquire(m, row, column, key, tout, op, __builtin_return_address(0));
+	
+	if (src == NULL)
+		return NULL;
+	
+	if (op == MAP2_OP_READONLY) {
+		// Cópia dos dados para uso no modo somente leitura
+		// Isso garante que os dados alterados em 'field' não são replicados
+		// para o mapa
+		if (dst != NULL) {
+			memcpy(dst, src, m->field_size);
+			MAP2_TRACE(copy, m, m->name, row, column, m->field_size);
+		}
+	}
+	else {
+		// Modo leitura e escrita, apenas aponta 'field' para o mapa, assim,
+		// o acesso é diretamente no mapa
+		dst = src;
+	}
+	
+	if (dst == NULL || op == MAP2_OP_READONLY) {
+		// Qualquer erro libera o mutex
+		// Como vamos usar map2_readonly() ou map2_readwrite(), não precisamos
+		// se preocupar com liberar o mutex em caso de erro
+		__map2_release(m, row, column, key);
+	}
+	
+	return dst;
+}
+
+/**
+	@brief Leitura de um item junto com a sua idade
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param dst Destino onde os dados do item serão copiados
+	@param tout Timeout de acesso
+	@param age Destino da idade do item, ver map2_age(..)
+	
+	@return 'dst' ou, NULL quando ocorrer erro no acesso
+*/
+void *__map2_take_age(const map2_t *m, int row, int column, int key, void *dst, uint32_t tout, uint32_t *age) {
+	MAP2_ASSERT(dst == NULL || age == NULL, return NULL);
+	
+	void *src = __map2_acquire(m, row, column, key, tout, MAP2_OP_READONLY, __builtin_return_address(0));
+	
+	MAP2_ASSERT(src == NULL, return NULL);
+	
+	memcpy(dst, src, m->field_size);
+	*age = m->stamp != NULL ? map2_age(m, row, column) : MAP2_AGE_NEVER;
+	__map2_release(m, row, column, key);
+	
+	return dst;
+}
+
+/**
+	@def map2_packed_mask Máscara de um campo do mapa compactado
+*/
+#define map2_packed_mask(f)		((f).width >= 32 ? 0xFFFFFFFFu : ((1u << (f).width) - 1))
+
+/**
+	@brief Retorna a palavra que contém o campo de um item do mapa compactado
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param f Campo do item
+	@param shift Posição do campo na palavra
+	
+	@return Ponteiro para a palavra ou, NULL quando o item ou o campo é inválido
+*/
+static uint32_t *__map2_packed_word(const map2_packed_t *m, int row, int column, map2_bitfield_t f, int *shift) {
+	MAP2_ASSERT(m == NULL, return NULL);
+	MAP2_ASSERT(row < 0 || row >= m->rows || column < 0 || column >= m->columns, return NULL);
+	MAP2_ASSERT(f.width == 0 || f.shift + f.width > m->bits, return NULL);
+	
+	int per = 32 / m->bits;
+	int cell = column + m->columns * row;
+	
+	*shift = (cell % per) * m->bits + f.shift;
+	return &m->data[cell / per];
+}
+
+/**
+	@brief Leitura atômica de um campo do mapa compactado
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param f Campo do item
+	
+	@return Valor do campo ou, 0 quando o item ou o campo é inválido
+*/
+uint32_t map2_packed_get(const map2_packed_t *m, int row, int column, map2_bitfield_t f) {
+	int shift;
+	uint32_t *w = __map2_packed_word(m, row, column, f, &shift);
+	
+	MAP2_ASSERT(w == NULL, return 0);
+	
+	return (MAP2_ATOMIC_LOAD(w) >> shift) & map2_packed_mask(f);
+}
+
+/**
+	@brief Escrita atômica de um campo do mapa compactado
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param f Campo do item
+	@param value Novo valor do campo
+	
+	@return true quando o campo foi alterado ou, false quando o item, o campo ou
+	o valor é inválido
+	
+	@note Os demais campos da palavra não são afetados, mesmo que alterados ao
+	mesmo tempo por outra tarefa
+*/
+bool map2_packed_set(const map2_packed_t *m, int row, int column, map2_bitfield_t f, uint32_t value) {
+	int shift;
+	uint32_t *w = __map2_packed_word(m, row, column, f, &shift);
+	
+	MAP2_ASSERT(w == NULL, return false);
+	MAP2_ASSERT(value > map2_packed_mask(f), return false);
+	
+	uint32_t mask = map2_packed_mask(f) << shift;
+	uint32_t old = MAP2_ATOMIC_LOAD(w);
+	
+	while (!MAP2_ATOMIC_CAS(w, &old, (old & ~mask) | (value << shift)));
+	
+	return true;
+}
+
+/**
+	@brief Altera um campo do mapa compactado somente se o valor atual for o
+	esperado
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param f Campo do item
+	@param expected Valor esperado do campo
+	@param value Novo valor do campo
+	
+	@return true quando o campo foi alterado
+*/
+bool map2_packed_cas(const map2_packed_t *m, int row, int column, map2_bitfield_t f, uint32_t expected, uint32_t value) {
+	int shift;
+	uint32_t *w = __map2_packed_word(m, row, column, f, &shift);
+	
+	MAP2_ASSERT(w == NULL, return false);
+	MAP2_ASSERT(value > map2_packed_mask(f), return false);
+	
+	uint32_t mask = map2_packed_mask(f) << shift;
+	uint32_t old = MAP2_ATOMIC_LOAD(w);
+	
+	do {
+		if (((old & mask) >> shift) != expected)
+			return false;
+	} while (!MAP2_ATOMIC_CAS(w, &old, (old & ~mask) | (value << shift)));
+	
+	return true;
+}
+
+/**
+	@brief Liga ou desliga um campo de 1 bit do mapa compactado
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param f Campo do item (1 bit)
+	@param on Novo estado do campo
+	
+	@return true quando o campo foi alterado
+	
+	@note Utiliza uma única operação atômica, sem laço de repetição
+*/
+bool map2_packed_flag(const map2_packed_t *m, int row, int column, map2_bitfield_t f, bool on) {
+	int shift;
+	uint32_t *w = __map2_packed_word(m, row, column, f, &shift);
+	
+	MAP2_ASSERT(w == NULL || f.width != 1, return false);
+	
+	if (on)
+		MAP2_ATOMIC_FETCH_OR(w, 1u << shift);
+	else
+		MAP2_ATOMIC_FETCH_AND(w, ~(1u << shift));
+	
+	return true;
+}
+
+/**
+	@brief Liberação do acesso a uma linha sem registrar escrita
+*/
+static void __map2_release_row(const map2_t *m, int row, int key) {
+	#ifdef MAP2_CONFIG_DBG_DROP
+		dbgW("Drop row:%d key:%d task:%d\n", row, key, os_tsk_self());
+	#endif
+	
+	#ifdef MAP2_CONFIG_SAMPLE
+		__map2_sample_drop(m, key);
+	#endif
+	
+	#ifdef MAP2_CONFIG_RECORD
+		__map2_record_drop(m, key);
+	#endif
+	
+	__map2_unlock_row(m, row, key);
+	
+	MAP2_TRACE(released, m, m->name, key, row, -1, MAP2_TRACE_ENABLED(released) ? MAP2_TIMESTAMP() : 0);
+}
+
+/**
+	@brief Liberação do acesso a uma linha do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição da linha
+	@param key Poisição da chave de acesso
+	
+	@note Todas as colunas da linha são consideradas escritas, ver
+	__map2_drop(..)
+*/
+void __map2_drop_row(const map2_t *m, int row, int key) {
+	MAP2_ASSERT(m == NULL, return);
+	MAP2_ASSERT(row < 0 || row >= m->rows, return);
+	MAP2_ASSERT(key < 0 || key >= m->keys, return);
+	
+	for (int c = 0; (m->history != NULL || m->window != NULL || m->stamp != NULL) && c < m->columns; c++)
+		__map2_written(m, row, c);
+	
+	__map2_release_row(m, row, key);
+}
+
+/**
+	@brief Aguarda e aloca a chave de uma linha, com as estatísticas, amostras
+	e registros do acesso, ver __map2_acquire(..)
+	
+	@param m Endereço do mapa
+	@param row Posição da linha
+	@param key Poisição da chave de acesso
+	@param tout Timeout de acesso
+	@param op Modo de operação registrado
+	@param site Endereço de onde o acesso foi requisitado (MAP2_CONFIG_SAMPLE)
+	
+	@return Ponteiro para a primeira coluna da linha, com a chave alocada, ou
+	NULL quando ocorrer erro no acesso
+*/
+static void *__map2_acquire_row(const map2_t *m, int row, int key, uint32_t tout, map2_operation_t op, const void *site) {
+	MAP2_ASSERT(m == NULL, return NULL);
+	MAP2_ASSERT(row < 0 || row >= m->rows, return NULL);
+	MAP2_ASSERT(key < 0 || key >= m->keys, return NULL);
+	
+	// Mesmo limite de timeout de __map2_acquire()
+	if (tout >= 0xFFFF)
+		tout -= 1;
+	
+	#ifdef MAP2_CONFIG_DBG_WAIT
+		dbgW("Wait row:%d key:%d task:%d timeout:%d op:%d\n", row, key, os_tsk_self(), tout, op);
+	#endif
+	
+	(void)op;
+	(void)site;
+	
+	#ifdef MAP2_CONFIG_SAMPLE
+		// O instante só é lido quando o acesso pode ser registrado
+		bool sample = __map2_sample_pick(m, key);
+		uint32_t wait = sample ? 0 : MAP2_ATOMIC_LOAD(&__map2_sample_wait);
+		uint32_t start = sample || wait != 0 ? MAP2_TIMESTAMP() : 0;
+	#endif
+	
+	#ifdef MAP2_CONFIG_USDT
+		uint32_t trace = MAP2_TRACE_ENABLED(acquired) || MAP2_TRACE_ENABLED(timeout) ? MAP2_TIMESTAMP() : 0;
+	#endif
+	
+	// Pontos de rastreamento com coluna -1, a linha inteira
+	MAP2_TRACE(wait, m, m->name, key, row, -1, op, tout);
+	
+	if (!__map2_lock_row(m, row, key, tout)) {
+		#ifdef MAP2_CONFIG_DBG_TIMEOUT
+			dbgW("Timeout row:%d key:%d task:%d timeout:%d\n", row, key, os_tsk_self(), tout);
+		#endif
+		MAP2_TRACE(timeout, m, m->name, key, row, -1, op, MAP2_TRACE_ENABLED(timeout) ? MAP2_TIMESTAMP() - trace : 0);
+		return NULL;
+	}
+	
+	#ifdef MAP2_CONFIG_USDT
+		if (MAP2_TRACE_ENABLED(acquired)) {
+			uint32_t now = MAP2_TIMESTAMP();
+			MAP2_TRACE(acquired, m, m->name, key, row, -1, op, now - trace, now);
+		}
+	#endif
+	
+	#ifdef MAP2_CONFIG_SAMPLE
+		if (sample || wait != 0)
+			__map2_sample_take(m, row, -1, key, op, site, start, wait);
+	#endif
+	
+	#ifdef MAP2_CONFIG_RECORD
+		__map2_record_take(m, row, -1, key, op);
+	#endif
+	
+	void *src = map2_ptr(m->data, map2_pos(m, row, 0), void);
+	
+	#ifdef MAP2_CONFIG_DBG_TAKE
+		dbgW("Take row:%d key:%d task:%d\n", row, key, os_tsk_self());
+	#endif
+	
+	return src;
+}
+
+/**
+	@brief Aguarda e aloca o acesso a todas as colunas de uma linha do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição da linha
+	@param key Poisição da chave de acesso
+	@param dst Destino onde os dados da linha serão copiados (somente leitura)
+	@param size Tamanho de 'dst', deve ser igual ao tamanho da linha
+	@param tout Timeout de acesso
+	@param op Modo de operação
+
+	@return Ponteiro para 'dst' no modo somente leitura, ponteiro para a
+	primeira coluna da linha no modo leitura/escrita ou, NULL quando ocorrer
+	erro no acesso
+*/
+void *__map2_take_row(const map2_t *m, int row, int key, void *dst, size_t size, uint32_t tout, map2_operation_t op) {
+	MAP2_ASSERT(m == NULL, return NULL);
+	MAP2_ASSERT(op == MAP2_OP_READONLY && (dst == NULL || size != (size_t)m->columns * m->field_size), return NULL);
+	MAP2_ASSERT(op == MAP2_OP_READWRITE && m->slab != NULL, return NULL);
+	
+	// Endereço de retorno, dentro da função que utilizou map2_*_row()
+	void *src = __map2_acquire_row(m, row, key, tout, op, __builtin_return_address(0));
+	
+	if (src == NULL || op == MAP2_OP_READWRITE)
+		return src;
+	
+	// As colunas de uma linha são contíguas, uma única cópia é suficiente
+	memcpy(dst, src, size);
+	__map2_release_row(m, row, key);
+	
+	return dst;
+}
+
+/**
+	@brief Substitui todas as colunas de uma linha do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição da linha
+	@param key Poisição da chave de acesso
+	@param src Dados da linha
+	@param size Tamanho de 'src', deve ser igual ao tamanho da linha
+	@param tout Timeout de acesso
+	
+	@return true quando a linha foi substituída
+*/
+bool __map2_put_row(const map2_t *m, int row, int key, const void *src, size_t size, uint32_t tout) {
+	MAP2_ASSERT(m == NULL || src == NULL, return false);
+	MAP2_ASSERT(size != (size_t)m->columns * m->field_size, return false);
+	MAP2_ASSERT(m->slab != NULL, return false);
+	
+	// Amostra atribuída a quem utilizou map2_write_row(), não a esta função
+	void *dst = __map2_acquire_row(m, row, key, tout, MAP2_OP_READWRITE, __builtin_return_address(0));
+	
+	MAP2_ASSERT(dst == NULL, return false);
+	
+	memcpy(dst, src, size);
+	__map2_drop_row(m, row, key);
+	
+	return true;
+}
+
+/**
+	@brief Compara dois blocos de memória
+	
+	@return true quando iguais
+	
+	A diferença é acumulada palavra a palavra sem desvios, a cada 8 palavras,
+	permitindo que o compilador utilize instruções vetoriais quando disponíveis
+*/
+static bool __map2_equal(const void *a, const void *b, size_t size) {
+	const uint8_t *pa = a;
+	const uint8_t *pb = b;
+	size_t i = 0;
+	
+	for (; i + 8 * sizeof(uint32_t) <= size; i += 8 * sizeof(uint32_t)) {
+		uint32_t wa[8], wb[8], diff = 0;
+		
+		// memcpy evita acessos desalinhados, vira leituras simples de palavra
+		memcpy(wa, pa + i, sizeof(wa));
+		memcpy(wb, pb + i, sizeof(wb));
+		
+		for (int w = 0; w < 8; w++)
+			diff |= wa[w] ^ wb[w];
+		
+		if (diff != 0)
+			return false;
+	}
+	
+	for (; i + sizeof(uint32_t) <= size; i += sizeof(uint32_t)) {
+		uint32_t wa, wb;
+		
+		memcpy(&wa, pa + i, sizeof(wa));
+		memcpy(&wb, pb + i, sizeof(wb));
+		
+		if (wa != wb)
+			return false;
+	}
+	
+	for (; i < size; i++) {
+		if (pa[i] != pb[i])
+			return false;
+	}
+	
+	return true;
+}
+
+/**
+	@brief Escreve um item do mapa somente quando o valor é diferente
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param src Novo valor do item
+	@param size Tamanho de 'src', deve ser igual ao tamanho do item
+	@param tout Timeout de acesso
+	
+	@return 1 quando o item foi alterado, 0 quando o valor era o mesmo ou, -1
+	quando ocorrer erro no acesso
+*/
+int __map2_put_changed(const map2_t *m, int row, int column, int key, const void *src, size_t size, uint32_t tout) {
+	MAP2_ASSERT(m == NULL || src == NULL, return -1);
+	MAP2_ASSERT(size != m->field_size, return -1);
+	MAP2_ASSERT(m->slab != NULL, return -1);
+	
+	// Amostra atribuída a quem utilizou map2_write_changed()
+	void *dst = __map2_acquire(m, row, column, key, tout, MAP2_OP_READWRITE, __builtin_return_address(0));
+	
+	MAP2_ASSERT(dst == NULL, return -1);
+	
+	bool changed = !__map2_equal(dst, src, size);
+	
+	if (changed) {
+		memcpy(dst, src, size);
+		__map2_drop(m, row, column, key);
+	}
+	else {
+		__map2_release(m, row, column, key);
+	}
+	
+	return changed ? 1 : 0;
+}
+
+/**
+	@brief Copia um item entre o mapa e a posição 'i' de um vetor contíguo
+	
+	@param m Endereço do mapa
+	@param cell Posição do item
+	@param buf Vetor contíguo de itens
+	@param i Posição no vetor
+	@param op MAP2_OP_READONLY copia do mapa para 'buf', MAP2_OP_READWRITE
+	copia de 'buf' para o mapa
+*/
+static void __map2_copy_cell(const map2_t *m, const map2_cell_t *cell, void *buf, int i, map2_operation_t op) {
+	void *item = map2_ptr(m->data, map2_pos(m, cell->row, cell->column), void);
+	void *pos = map2_ptr(buf, (size_t)i * m->field_size, void);
+	
+	if (op == MAP2_OP_READONLY) {
+		memcpy(pos, item, m->field_size);
+	}
+	else {
+		memcpy(item, pos, m->field_size);
+		__map2_written(m, cell->row, cell->column);
+	}
+}
+
+/**
+	@brief Copia ou escreve uma lista de itens agrupando o acesso por chave
+	
+	@param m Endereço do mapa
+	@param cells Lista de itens
+	@param n Quantidade de itens
+	@param buf Vetor contíguo com um item para cada posição de 'cells'
+	@param tout Timeout de acesso
+	@param op MAP2_OP_READONLY copia do mapa para 'buf', MAP2_OP_READWRITE
+	copia de 'buf' para o mapa
+	@param site Endereço de onde o acesso foi requisitado (MAP2_CONFIG_SAMPLE)
+	
+	@return Quantidade de itens copiados ou, -1 quando algum item possui
+	posição ou chave inválida
+	
+	@note Cada chave utilizada pelos itens é alocada uma única vez. Itens de uma
+	chave que não pôde ser alocada (timeout) não são copiados
+*/
+static int __map2_transfer(const map2_t *m, const map2_cell_t *cells, int n, void *buf, uint32_t tout, map2_operation_t op, const void *site) {
+	MAP2_ASSERT(m == NULL || cells == NULL || buf == NULL || n < 0, return -1);
+	
+	MAP2_ASSERT(op == MAP2_OP_READWRITE && m->slab != NULL, return -1);
+	
+	// Uma posição ou chave inválida falha a transferência inteira, como em
+	// __map2_take()
+	for (int i = 0; i < n; i++) {
+		MAP2_ASSERT(cells[i].row < 0 || cells[i].row >= m->rows || cells[i].column < 0 || cells[i].column >= m->columns, return -1);
+		MAP2_ASSERT(m->lck == NULL && map2_key(m, cells[i].row) < 0, return -1);
+	}
+	
+	int done = 0;
+	
+	if (m->lck != NULL) {
+		// Com trava por item não há chave para agrupar, cada item é alocado
+		// separadamente
+		for (int i = 0; i < n; i++) {
+			if (__map2_acquire(m, cells[i].row, cells[i].column, 0, tout, op, site) == NULL)
+				continue;
+			__map2_copy_cell(m, &cells[i], buf, i, op);
+			__map2_release(m, cells[i].row, cells[i].column, 0);
+			done++;
+		}
+		return done;
+	}
+	
+	for (int k = 0; k < m->keys; k++) {
+		int first = 0;
+		
+		while (first < n && map2_key(m, cells[first].row) != k)
+			first++;
+		
+		if (first == n)
+			continue;
+		
+		// Amostras, registros e rastreamento utilizam o primeiro item da chave
+		if (__map2_acquire(m, cells[first].row, cells[first].column, k, tout, op, site) == NULL)
+			continue;
+		
+		for (int i = first; i < n; i++) {
+			if (map2_key(m, cells[i].row) == k) {
+				__map2_copy_cell(m, &cells[i], buf, i, op);
+				done++;
+			}
+		}
+		
+		__map2_release(m, cells[first].row, cells[first].column, k);
+	}
+	
+	return done;
+}
+
+/**
+	@brief Copia uma lista de itens do mapa para um vetor contíguo
+	
+	@param m Endereço do mapa
+	@param cells Lista de itens
+	@param n Quantidade de itens
+	@param dst Vetor com 'n' itens, onde os dados serão copiados na mesma ordem
+	de 'cells'
+	@param tout Timeout de acesso
+	
+	@return Quantidade de itens copiados ou, -1 quando algum item possui
+	posição ou chave inválida
+	
+	Exemplo:
+		const map2_cell_t cells[] = {{0, 1}, {5, 0}, {17, 2}, {2, 3}};
+		t_t report[4];
+		if (map2_gather(&my_map1, cells, 4, report, 2000) == 4) {
+			...
+		}
+	
+	@note Os itens são agrupados por map2_key(..), logo cada chave é alocada uma
+	única vez, no máximo MAP2_NKEYS_3 acessos
+*/
+int map2_gather(const map2_t *m, const map2_cell_t *cells, int n, void *dst, uint32_t tout) {
+	return __map2_transfer(m, cells, n, dst, tout, MAP2_OP_READONLY, __builtin_return_address(0));
+}
+
+/**
+	@brief Escreve uma lista de itens no mapa a partir de um vetor contíguo
+	
+	@param m Endereço do mapa
+	@param cells Lista de itens
+	@param n Quantidade de itens
+	@param src Vetor com 'n' itens, na mesma ordem de 'cells'
+	@param tout Timeout de acesso
+	
+	@return Quantidade de itens escritos ou, -1 quando algum item possui
+	posição ou chave inválida
+	
+	@note Os itens são agrupados por map2_key(..), logo cada chave é alocada uma
+	única vez, no máximo MAP2_NKEYS_3 acessos
+*/
+int map2_scatter(const map2_t *m, const map2_cell_t *cells, int n, const void *src, uint32_t tout) {
+	return __map2_transfer(m, cells, n, (void*)(uintptr_t)src, tout, MAP2_OP_READWRITE, __builtin_return_address(0));
+}
+
+/**
+	@brief Copia apenas alguns campos de um item do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Posição da chave de acesso
+	@param fields Campos do item, ver MAP2_FIELD(..)
+	@param n Quantidade de campos
+	@param dst Destino, os campos são copiados em sequência, sem espaço entre
+	eles, na ordem de 'fields'
+	@param tout Timeout de acesso
+	
+	@return Quantidade de bytes copiados ou, 0 quando ocorrer erro no acesso
+	
+	Evita copiar o item inteiro quando apenas alguns campos são necessários,
+	reduzindo o tempo com a chave alocada em itens grandes
+	
+	Exemplo:
+		struct __attribute__((packed)) {
+			uint8_t status;
+			int32_t value;
+		} out;
+		if (map2_project(&my_map1, c, 0, map2_key(&my_map1, c),
+			MAP2_FIELDS(MAP2_FIELD(t_t, status), MAP2_FIELD(t_t, value)), &out, 2000)) {
+			...
+		}
+	
+	@note 'dst' é compacto, utilize uma estrutura 'packed' ou copie cada campo
+	com memcpy quando os campos não estiverem alinhados
+*/
+size_t map2_project(const map2_t *m, int row, int column, int key, const map2_field_t *fields, int n, void *dst, uint32_t tout) {
+	MAP2_ASSERT(m == NULL || fields == NULL || n <= 0 || dst == NULL, return 0);
+	
+	for (int i = 0; i < n; i++)
+		MAP2_ASSERT((size_t)fields[i].offset + fields[i].size > m->field_size, return 0);
+	
+	const uint8_t *src = __map2_acquire(m, row, column, key, tout, MAP2_OP_READONLY, __builtin_return_address(0));
+	size_t pos = 0;
+	
+	MAP2_ASSERT(src == NULL, return 0);
+	
+	for (int i = 0; i < n; i++) {
+		memcpy((uint8_t*)dst + pos, src + fields[i].offset, fields[i].size);
+		pos += fields[i].size;
+	}
+	
+	__map2_release(m, row, column, key);
+	
+	return pos;
+}
+
+/**
+	@brief Grava o valor atual de um item no histórico
+	
+	@param m Endereço do mapa, criado com MAP2_HISTORY(..)
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Posição da chave de acesso
+	@param tout Timeout de acesso
+	
+	@return true quando o valor foi gravado
+	
+	Utilizado quando o item é alterado sem as funções de escrita do mapa, por
+	exemplo com map2_unsafe_foreach(..) na inicialização
+*/
+bool map2_history_append(const map2_t *m, int row, int column, int key, uint32_t tout) {
+	MAP2_ASSERT(m == NULL || m->history == NULL, return false);
+	
+	void *item = __map2_acquire(m, row, column, key, tout, MAP2_OP_READWRITE, __builtin_return_address(0));
+	
+	MAP2_ASSERT(item == NULL, return false);
+	
+	__map2_drop(m, row, column, key);
+	
+	return true;
+}
+
+/**
+	@brief Lê o histórico de valores de um item
+	
+	@param m Endereço do mapa, criado com MAP2_HISTORY(..)
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param stamps Destino dos instantes de cada valor, em unidades de
+	MAP2_TIMESTAMP(), ou NULL
+	@param values Destino dos valores, vetor de itens ou, com
+	MAP2_HISTORY_FIELD(..), vetor do tipo do campo
+	@param max Quantidade máxima de valores
+	
+	@return Quantidade de valores copiados, do mais antigo para o mais recente
+	
+	Não aloca a chave. A cópia é repetida quando o item é escrito durante a
+	leitura, assim os valores retornados são sempre uma janela consistente
+	
+	Exemplo:
+		uint32_t stamps[16];
+		int32_t values[16];
+		int n = map2_history_read(&my_map7, c, 0, stamps, values, 16);
+		for (int i = 1; i < n; i++)
+			rate = (values[i] - values[i - 1]) / (stamps[i] - stamps[i - 1]);
+*/
+int map2_history_read(const map2_t *m, int row, int column, uint32_t *stamps, void *values, int max) {
+	MAP2_ASSERT(m == NULL || m->history == NULL || values == NULL || max <= 0, return 0);
+	MAP2_ASSERT(row < 0 || row >= m->rows || column < 0 || column >= m->columns, return 0);
+	
+	const map2_history_t *h = m->history;
+	size_t cell = (size_t)row * (size_t)m->columns + (size_t)column;
+	size_t vsize = h->field.size != 0 ? h->field.size : m->field_size;
+	
+	for (int spin = 0;; spin++) {
+		uint32_t seq = MAP2_ATOMIC_LOAD(&h->seq[cell]);
+		
+		if (seq & 1) {
+			__map2_seq_wait(spin);
+			continue;
+		}
+		
+		uint32_t count = seq / 2;
+		int n = (int)(count < h->depth ? count : h->depth);
+		
+		if (n > max)
+			n = max;
+		
+		for (int i = 0; i < n; i++) {
+			const uint32_t *e = &h->ring[(cell * h->depth + (count - (uint32_t)n + (uint32_t)i) % h->depth) * h->words];
+			
+			if (stamps != NULL)
+				stamps[i] = e[0];
+			memcpy((uint8_t*)values + (size_t)i * vsize, &e[1], vsize);
+		}
+		
+		MAP2_ATOMIC_FENCE();
+		
+		if (MAP2_ATOMIC_LOAD(&h->seq[cell]) == seq)
+			return n;
+	}
+}
+
+/**
+	@brief Idade de um item do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	
+	@return Ticks desde a última escrita do item ou, MAP2_AGE_NEVER quando o
+	item nunca foi escrito ou o mapa não registra o instante da escrita
+	(MAP2_CONFIG_STAMP)
+	
+	@note Não aloca a chave
+*/
+uint32_t map2_age(const map2_t *m, int row, int column) {
+	MAP2_ASSERT(m == NULL || m->stamp == NULL, return MAP2_AGE_NEVER);
+	MAP2_ASSERT(row < 0 || row >= m->rows || column < 0 || column >= m->columns, return MAP2_AGE_NEVER);
+	
+	uint32_t stamp = MAP2_ATOMIC_LOAD(&m->stamp[(size_t)row * (size_t)m->columns + (size_t)column]);
+	
+	return stamp != 0 ? os_time_get() - stamp : MAP2_AGE_NEVER;
+}
+
+/**
+	@brief Estatísticas por janela de um item
+	
+	@param m Endereço do mapa, criado com MAP2_WINDOW(..)
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param stats Destino das estatísticas
+	
+	@return true quando o item possui escritas nas duas últimas janelas
+	
+	Não aloca a chave, a cópia é repetida quando o item é escrito durante a
+	leitura. As janelas são avançadas até o tick atual na cópia, assim um item
+	sem escritas tem 'count' e 'rate' zerados
+	
+	Exemplo:
+		map2_window_stats_t s;
+		if (map2_window_read(&my_map8, c, 0, &s))
+			dbgW("min:%d max:%d ema:%d rate:%u\n", s.min, s.max, s.ema, s.rate);
+*/
+bool map2_window_read(const map2_t *m, int row, int column, map2_window_stats_t *stats) {
+	MAP2_ASSERT(m == NULL || m->window == NULL || stats == NULL, return false);
+	MAP2_ASSERT(row < 0 || row >= m->rows || column < 0 || column >= m->columns, return false);
+	
+	const map2_window_t *w = m->window;
+	const map2_window_cell_t *src = &w->cells[(size_t)row * (size_t)m->columns + (size_t)column];
+	map2_window_cell_t c;
+	
+	for (int spin = 0;; spin++) {
+		uint32_t seq = MAP2_ATOMIC_LOAD(&src->seq);
+		
+		if (seq & 1) {
+			__map2_seq_wait(spin);
+			continue;
+		}
+		
+		memcpy(&c, src, sizeof(c));
+		MAP2_ATOMIC_FENCE();
+		
+		if (MAP2_ATOMIC_LOAD(&src->seq) == seq)
+			break;
+	}
+	
+	__map2_window_roll(w, &c, os_time_get());
+	
+	memset(stats, 0, sizeof(*stats));
+	stats->last = c.last;
+	stats->ema = (int32_t)((c.ema + 128) >> 8);
+	stats->count = c.count[0];
+	stats->rate = c.count[1];
+	stats->total = c.count[0] + c.count[1];
+	
+	// min e max iniciam pela primeira janela com escritas, não pelo 0
+	bool seeded = false;
+	
+	for (int i = 0; i < 2; i++) {
+		if (c.count[i] == 0)
+			continue;
+		if (!seeded || c.min[i] < stats->min)
+			stats->min = c.min[i];
+		if (!seeded || c.max[i] > stats->max)
+			stats->max = c.max[i];
+		seeded = true;
+	}
+	
+	return stats->total != 0;
+}
+
+/**
+	@brief Índice do bloco de um ponteiro do pool
+	
+	@return Índice do bloco ou, -1 quando 'buf' não é um bloco do pool
+*/
+static int __map2_slab_index(const map2_slab_t *s, const void *buf) {
+	uintptr_t offset = (uintptr_t)buf - (uintptr_t)s->blocks;
+	
+	MAP2_ASSERT((uintptr_t)buf < (uintptr_t)s->blocks, return -1);
+	MAP2_ASSERT(offset % s->size != 0 || offset / s->size >= s->count, return -1);
+	
+	return (int)(offset / s->size);
+}
+
+/**
+	@brief Libera uma referência de um bloco, o bloco retorna à lista de livres
+	com a última referência
+*/
+static void __map2_slab_drop(map2_slab_t *s, int index) {
+	uint32_t ref = MAP2_ATOMIC_LOAD(&s->ref[index]);
+	
+	do {
+		MAP2_ASSERT(ref == 0, return);
+	} while (!MAP2_ATOMIC_CAS(&s->ref[index], &ref, ref - 1));
+	
+	if (ref != 1)
+		return;
+	
+	uint32_t top = MAP2_ATOMIC_LOAD(&s->free);
+	uint32_t top_new;
+	
+	do {
+		s->next[index] = (uint16_t)(top & 0xFFFF);
+		top_new = ((top & 0xFFFF0000u) + 0x10000u) | (uint32_t)(index + 1);
+	} while (!MAP2_ATOMIC_CAS(&s->free, &top, top_new));
+}
+
+/**
+	@brief Obtém um bloco livre do pool de um mapa indireto
+	
+	@param m Endereço do mapa, criado com MAP2_INDIRECT(..)
+	
+	@return Bloco com uma referência, do chamador, ou NULL quando o pool está
+	cheio
+	
+	O bloco é preenchido pelo chamador e publicado com map2_indirect_put(..)
+	ou, descartado com map2_indirect_release(..)
+	
+	@note Não aloca chave, pode ser chamada por qualquer tarefa
+*/
+void *map2_indirect_alloc(const map2_t *m) {
+	MAP2_ASSERT(m == NULL || m->slab == NULL, return NULL);
+	
+	map2_slab_t *s = m->slab;
+	uint32_t top = MAP2_ATOMIC_LOAD(&s->free);
+	int index = -1;
+	
+	while ((top & 0xFFFF) != 0) {
+		uint32_t next = s->next[(top & 0xFFFF) - 1];
+		uint32_t top_new = ((top & 0xFFFF0000u) + 0x10000u) | next;
+		
+		if (MAP2_ATOMIC_CAS(&s->free, &top, top_new)) {
+			index = (int)(top & 0xFFFF) - 1;
+			break;
+		}
+	}
+	
+	// Lista de livres vazia, utiliza um bloco ainda não utilizado
+	if (index < 0) {
+		uint32_t used = MAP2_ATOMIC_LOAD(&s->used);
+		
+		do {
+			MAP2_ASSERT(used >= s->count, return NULL);
+		} while (!MAP2_ATOMIC_CAS(&s->used, &used, used + 1));
+		
+		index = (int)used;
+	}
+	
+	s->length[index] = 0;
+	MAP2_ATOMIC_STORE(&s->ref[index], 1);
+	
+	return &s->blocks[(size_t)index * s->size];
+}
+
+/**
+	@brief Libera a referência a um bloco, obtida com map2_indirect_get(..) ou
+	map2_indirect_alloc(..)
+	
+	@param m Endereço do mapa, criado com MAP2_INDIRECT(..)
+	@param buf Bloco
+*/
+void map2_indirect_release(const map2_t *m, const void *buf) {
+	MAP2_ASSERT(m == NULL || m->slab == NULL || buf == NULL, return);
+	
+	int index = __map2_slab_index(m->slab, buf);
+	
+	MAP2_ASSERT(index < 0, return);
+	
+	__map2_slab_drop(m->slab, index);
+}
+
+/**
+	@brief Publica um bloco em um item indireto
+	
+	@param m Endereço do mapa, criado com MAP2_INDIRECT(..)
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param buf Bloco obtido com map2_indirect_alloc(..) ou, NULL para esvaziar
+	o item
+	@param length Bytes ocupados do bloco
+	@param tout Timeout de acesso
+	
+	@return true quando o bloco foi publicado, a referência do chamador passa
+	para o item. Em caso de erro, ou quando 'buf' já é o bloco do item, a
+	referência continua com o chamador
+	
+	O bloco anterior do item é liberado depois da troca, fora da chave. Leitores
+	que ainda o utilizam mantêm o bloco até map2_indirect_release(..)
+	
+	@note O bloco não deve ser alterado depois de publicado
+*/
+bool map2_indirect_put(const map2_t *m, int row, int column, int key, void *buf, uint32_t length, uint32_t tout) {
+	MAP2_ASSERT(m == NULL || m->slab == NULL, return false);
+	
+	map2_slab_t *s = m->slab;
+	int index = buf != NULL ? __map2_slab_index(s, buf) : -1;
+	
+	MAP2_ASSERT(buf != NULL && (index < 0 || length > s->size), return false);
+	
+	uint32_t *cell = __map2_acquire(m, row, column, key, tout, MAP2_OP_READWRITE, __builtin_return_address(0));
+	
+	MAP2_ASSERT(cell == NULL, return false);
+	
+	uint32_t old = *cell;
+	
+	// O bloco já publicado no item possui a referência do item, liberar a
+	// anterior devolveria o bloco ao pool ainda publicado
+	if (buf != NULL && old == (uint32_t)(index + 1)) {
+		__map2_release(m, row, column, key);
+		return false;
+	}
+	
+	if (index >= 0)
+		s->length[index] = length;
+	
+	*cell = (uint32_t)(index + 1);
+	__map2_drop(m, row, column, key);
+	
+	if (old != 0)
+		__map2_slab_drop(s, (int)old - 1);
+	
+	return true;
+}
+
+/**
+	@brief Obtém uma referência ao conteúdo de um item indireto, sem cópia
+	
+	@param m Endereço do mapa, criado com MAP2_INDIRECT(..)
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param length Destino do tamanho do conteúdo, pode ser NULL
+	@param tout Timeout de acesso
+	
+	@return Conteúdo do item ou, NULL quando o item está vazio ou ocorrer erro
+	no acesso
+	
+	A chave é alocada apenas para obter a referência. O conteúdo continua
+	válido, mesmo que o item seja substituído, até map2_indirect_release(..)
+	
+	Exemplo:
+		uint32_t length;
+		const uint8_t *frame = map2_indirect_get(&frames, c, 0, map2_key(&frames, c), &length, 2000);
+		if (frame != NULL) {
+			send(frame, length);
+			map2_indirect_release(&frames, frame);
+		}
+*/
+const void *map2_indirect_get(const map2_t *m, int row, int column, int key, uint32_t *length, uint32_t tout) {
+	MAP2_ASSERT(m == NULL || m->slab == NULL, return NULL);
+	
+	map2_slab_t *s = m->slab;
+	const uint32_t *cell = __map2_acquire(m, row, column, key, tout, MAP2_OP_READONLY, __builtin_return_address(0));
+	
+	MAP2_ASSERT(cell == NULL, return NULL);
+	
+	uint32_t handle = *cell;
+	
+	// A referência do item garante que o bloco não é liberado antes do
+	// incremento, a troca só ocorre com a chave alocada
+	if (handle != 0)
+		MAP2_ATOMIC_FETCH_ADD(&s->ref[handle - 1], 1);
+	
+	__map2_release(m, row, column, key);
+	
+	MAP2_ASSERT(handle == 0, return NULL);
+	
+	if (length != NULL)
+		*length = s->length[handle - 1];
+	
+	return &s->blocks[(size_t)(handle - 1) * s->size];
+}
+
+/**
+	@brief Lista os itens não escritos dentro de uma janela de tempo
+	
+	@param m Endereço do mapa
+	@param window Janela em ticks, itens com idade maior são listados
+	@param cells Destino dos itens, ou NULL para apenas contar
+	@param max Quantidade máxima de itens em 'cells'
+	
+	@return Quantidade de itens desatualizados, inclusive os que não couberam
+	em 'cells'
+	
+	Substitui os campos de heartbeat dos itens, monitores podem ignorar os
+	canais sem atualização sem ler cada item
+	
+	Exemplo:
+		map2_cell_t dead[8];
+		int n = map2_stale(&my_map1, 5000, dead, 8);
+		for (int i = 0; i < n && i < 8; i++)
+			dbgW("Stale row:%d column:%d\n", dead[i].row, dead[i].column);
+	
+	@note Não aloca a chave. Itens nunca escritos são considerados
+	desatualizados
+*/
+int map2_stale(const map2_t *m, uint32_t window, map2_cell_t *cells, int max) {
+	MAP2_ASSERT(m == NULL || m->stamp == NULL, return 0);
+	
+	uint32_t now = os_time_get();
+	int n = 0;
+	
+	for (int r = 0; r < m->rows; r++) {
+		for (int c = 0; c < m->columns; c++) {
+			uint32_t stamp = MAP2_ATOMIC_LOAD(&m->stamp[(size_t)r * (size_t)m->columns + (size_t)c]);
+			
+			if (stamp != 0 && now - stamp <= window)
+				continue;
+			
+			if (cells != NULL && n < max) {
+				cells[n].row = r;
+				cells[n].column = c;
+			}
+			n++;
+		}
+	}
+	
+	return n;
+}
+
+/**
+	@brief Estatísticas de acesso de uma chave do mapa
+	
+	@param m Endereço do mapa
+	@param key Posição da chave de acesso ou, -1 para o total de todas as chaves
+	@param stats Destino onde as estatísticas serão copiadas
+	
+	@return true quando as estatísticas foram copiadas ou, false quando o mapa
+	não possui estatísticas (MAP2_CONFIG_STATS)
+	
+	@note Os contadores são lidos individualmente, sem alocar a chave
+*/
+bool map2_stats(const map2_t *m, int key, map2_stats_t *stats) {
+	MAP2_ASSERT(m == NULL || m->stats == NULL || stats == NULL, return false);
+	MAP2_ASSERT(key < -1 || key >= m->keys, return false);
+	
+	uint32_t *dst = (uint32_t*)stats;
+	
+	memset(stats, 0, sizeof(*stats));
+	
+	// Todos os campos são uint32_t, inclusive os histogramas
+	for (int k = (key < 0 ? 0 : key); k < (key < 0 ? m->keys : key + 1); k++) {
+		uint32_t *src = (uint32_t*)&m->stats[k];
+		
+		for (size_t i = 0; i < sizeof(*stats) / sizeof(uint32_t); i++)
+			dst[i] += MAP2_ATOMIC_LOAD(&src[i]);
+	}
+	
+	#ifdef MAP2_CONFIG_STATS_HIST
+		stats->taken = 0;
+	#endif
+	
+	return true;
+}
+
+/**
+	@brief Zera as estatísticas de acesso de todas as chaves do mapa
+	
+	@param m Endereço do mapa
+*/
+void map2_stats_reset(const map2_t *m) {
+	MAP2_ASSERT(m == NULL || m->stats == NULL, return);
+	
+	for (int k = 0; k < m->keys; k++) {
+		uint32_t *s = (uint32_t*)&m->stats[k];
+		
+		for (size_t i = 0; i < sizeof(map2_stats_t) / sizeof(uint32_t); i++) {
+			#ifdef MAP2_CONFIG_STATS_HIST
+				// Preserva o instante de alocação de uma chave em uso
+				if (&s[i] == &m->stats[k].taken)
+					continue;
+			#endif
+			MAP2_ATOMIC_STORE(&s[i], 0);
+		}
+	}
+}
+
+/**
+	@brief Valor de um quantil do histograma
+	
+	@param h Histograma
+	@param num Numerador do quantil
+	@param den Denominador do quantil
+	
+	@return Limite superior da posição que contém o quantil ou, 0 quando o
+	histograma está vazio
+	
+	Exemplo:
+		map2_stats_t s;
+		map2_stats(&my_map1, -1, &s);
+		uint32_t p50 = map2_hist_quantile(&s.wait, 1, 2);
+		uint32_t p99 = map2_hist_quantile(&s.wait, 99, 100);
+		uint32_t p999 = map2_hist_quantile(&s.wait, 999, 1000);
+*/
+uint32_t map2_hist_quantile(const map2_hist_t *h, uint32_t num, uint32_t den) {
+	MAP2_ASSERT(h == NULL || den == 0 || num > den, return 0);
+	
+	const int sub = MAP2_CONFIG_HIST_SUB;
+	uint64_t total = 0;
+	
+	for (int i = 0; i < MAP2_HIST_BUCKETS; i++)
+		total += h->count[i];
+	
+	MAP2_ASSERT(total == 0, return 0);
+	
+	// Posição do valor de ordem ceil(total * num / den), no mínimo o primeiro
+	uint64_t rank = (total * num + den - 1) / den;
+	uint64_t seen = 0;
+	int i = 0;
+	
+	if (rank == 0)
+		rank = 1;
+	
+	for (; i < MAP2_HIST_BUCKETS - 1; i++) {
+		seen += h->count[i];
+		if (seen >= rank)
+			break;
+	}
+	
+	if (i < (1 << sub))
+		return (uint32_t)i;
+	
+	int e = (i >> sub) + sub - 1;
+	uint64_t low = (uint64_t)((1 << sub) + (i & ((1 << sub) - 1))) << (e - sub);
+	uint64_t high = low + ((uint64_t)1 << (e - sub)) - 1;
+	
+	return high > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)high;
+}
+
+/**
+	@brief Maior quantidade de disputas entre as chaves do mapa
+	
+	@param m Endereço do mapa
+	
+	@return Quantidade de disputas da chave mais disputada
+*/
+static uint32_t __map2_stats_max(const map2_t *m) {
+	uint32_t max = 0;
+	
+	for (int k = 0; k < m->keys; k++) {
+		uint32_t contended = MAP2_ATOMIC_LOAD(&m->stats[k].contended);
+		if (contended > max)
+			max = contended;
+	}
+	
+	return max;
+}
+
+/**
+	@brief Redistribui as linhas do mapa entre as chaves conforme as disputas
+	
+	@param m Endereço do mapa (MAP2_ADAPTIVE)
+	@param stripes Quantidade de chaves utilizadas, de 1 até a quantidade
+	máxima do mapa ou, 0 para utilizar todas. Pode ser maior que as chaves
+	iniciais de MAP2_ADAPTIVE_STRIPES(..), aumentando as chaves em uso
+	
+	@return true quando as linhas foram redistribuídas
+	
+	As linhas são ordenadas pela quantidade de disputas e, da mais disputada
+	para a menos disputada, atribuídas à chave com menor carga. Linhas sem
+	disputa também contam como carga, assim ficam distribuídas entre as chaves
+	
+	As disputas registradas e as estatísticas do mapa são zeradas, os totais
+	anteriores ficam disponíveis em map2_adapt_report(..)
+	
+	@note Não seguro! Nenhuma tarefa pode acessar o mapa durante o remapeamento
+*/
+bool map2_unsafe_restripe(const map2_t *m, int stripes) {
+	MAP2_ASSERT(m == NULL || m->adapt == NULL || m->stats == NULL, return false);
+	
+	map2_adapt_t *a = m->adapt;
+	
+	if (stripes <= 0 || stripes > m->keys)
+		stripes = m->keys;
+	
+	map2_stats(m, -1, &a->before);
+	a->before_max = __map2_stats_max(m);
+	
+	// Shell sort das linhas pela quantidade de disputas, da maior para a menor
+	for (int r = 0; r < m->rows; r++)
+		a->order[r] = (uint32_t)r;
+	
+	for (int gap = m->rows / 2; gap > 0; gap /= 2) {
+		for (int i = gap; i < m->rows; i++) {
+			uint32_t row = a->order[i];
+			int j = i;
+			
+			for (; j >= gap && a->hits[a->order[j - gap]] < a->hits[row]; j -= gap)
+				a->order[j] = a->order[j - gap];
+			a->order[j] = row;
+		}
+	}
+	
+	for (int k = 0; k < m->keys; k++)
+		a->load[k] = 0;
+	
+	for (int i = 0; i < m->rows; i++) {
+		uint32_t row = a->order[i];
+		int best = 0;
+		
+		for (int k = 1; k < stripes; k++) {
+			if (a->load[k] < a->load[best])
+				best = k;
+		}
+		
+		a->table[row] = (uint8_t)(best + 1);
+		a->load[best] += a->hits[row] + 1;
+		a->hits[row] = 0;
+	}
+	
+	a->stripes = (uint32_t)stripes;
+	map2_stats_reset(m);
+	a->restripes++;
+	
+	return true;
+}
+
+/**
+	@brief Contenção do mapa antes e depois do último remapeamento
+	
+	@param m Endereço do mapa (MAP2_ADAPTIVE)
+	@param report Destino do relatório
+	
+	@return true quando o relatório foi copiado
+	
+	Exemplo:
+		map2_adapt_report_t r;
+		if (map2_adapt_report(&my_map4, &r)) {
+			float before = (float)r.before.contended / r.before.acquisitions;
+			float after = (float)r.after.contended / r.after.acquisitions;
+		}
+*/
+bool map2_adapt_report(const map2_t *m, map2_adapt_report_t *report) {
+	MAP2_ASSERT(m == NULL || m->adapt == NULL || m->stats == NULL || report == NULL, return false);
+	
+	report->restripes = m->adapt->restripes;
+	report->stripes = m->adapt->stripes != 0 ? m->adapt->stripes : (uint32_t)(m->keymap->arg < m->keys ? m->keymap->arg : m->keys);
+	report->before = m->adapt->before;
+	report->before_max = m->adapt->before_max;
+	map2_stats(m, -1, &report->after);
+	report->after_max = __map2_stats_max(m);
+	
+	return true;
+}
+
+/**
+	@brief Quantidade de mapas registrados
+	
+	@return Quantidade de mapas, ver map2_registry_get(..)
+	
+	@note O mapa é registrado em map2_init(..) ou, no seu primeiro acesso
+*/
+int map2_registry_count(void) {
+	uint32_t count = MAP2_ATOMIC_LOAD(&__map2_registry_count);
+	
+	return (int)(count < MAP2_CONFIG_REGISTRY_MAX ? count : MAP2_CONFIG_REGISTRY_MAX);
+}
+
+/**
+	@brief Retorna um mapa registrado
+	
+	@param index Posição do mapa no registro, de 0 até map2_registry_count(..)
+	
+	@return Endereço do mapa ou, NULL quando a posição é inválida
+	
+	Exemplo:
+		for (int i = 0; i < map2_registry_count(); i++) {
+			map2_info_t info;
+			map2_stats_t stats;
+			const map2_t *m = map2_registry_get(i);
+			if (map2_info(m, &info) && map2_stats(m, -1, &stats)) {
+				...
+			}
+		}
+*/
+const map2_t *map2_registry_get(int index) {
+	MAP2_ASSERT(index < 0 || index >= map2_registry_count(), return NULL);
+	
+	return MAP2_ATOMIC_LOAD(&__map2_registry[index]);
+}
+
+/**
+	@brief Procura um mapa registrado pelo nome
+	
+	@param name Nome do mapa, o mesmo utilizado em MAP2(..)
+	
+	@return Endereço do mapa ou, NULL quando não encontrado
+*/
+const map2_t *map2_registry_find(const char *name) {
+	MAP2_ASSERT(name == NULL, return NULL);
+	
+	for (int i = 0; i < map2_registry_count(); i++) {
+		const map2_t *m = MAP2_ATOMIC_LOAD(&__map2_registry[i]);
+		
+		if (m != NULL && m->name != NULL && strcmp(m->name, name) == 0)
+			return m;
+	}
+	
+	return NULL;
+}
+
+/**
+	@brief Configuração e uso de memória de um mapa
+	
+	@param m Endereço do mapa
+	@param info Destino das informações
+	
+	@return true quando as informações foram copiadas
+*/
+bool map2_info(const map2_t *m, map2_info_t *info) {
+	MAP2_ASSERT(m == NULL || info == NULL, return false);
+	
+	size_t cells = (size_t)m->rows * (size_t)m->columns;
+	size_t keys = (size_t)m->keys;
+	
+	memset(info, 0, sizeof(*info));
+	info->name = m->name;
+	info->type = m->type;
+	info->rows = m->rows;
+	info->columns = m->columns;
+	info->keys = m->keys;
+	info->field_size = m->field_size;
+	info->row_size = (size_t)m->columns * m->field_size;
+	info->data_size = m->data_size;
+	info->keymap = m->keymap != NULL;
+	info->adaptive = m->adapt != NULL;
+	info->stats = m->stats != NULL;
+	info->footprint = sizeof(*m) + m->data_size;
+	
+	if (m->ready != NULL)
+		info->footprint += sizeof(map2_ready_t);
+	
+	if (m->lck != NULL) {
+		info->lock = MAP2_LOCK_CELL;
+		info->footprint += cells * sizeof(map2_cell_lock_t);
+	}
+	else if (m->fast != NULL) {
+		info->lock = MAP2_LOCK_FAST;
+		info->footprint += keys * sizeof(uint32_t);
+	}
+	else if (m->mut != NULL) {
+		info->lock = MAP2_LOCK_MUTEX;
+		info->footprint += keys * sizeof(OS_MUT);
+	}
+	
+	if (m->stats != NULL)
+		info->footprint += (m->lck != NULL ? 1 : keys) * sizeof(map2_stats_t);
+	if (m->owner != NULL)
+		info->footprint += keys * sizeof(map2_owner_t);
+	if (m->sample != NULL)
+		info->footprint += keys * sizeof(map2_sample_key_t);
+	if (m->record != NULL)
+		info->footprint += keys * sizeof(uint32_t);
+	if (m->stamp != NULL)
+		info->footprint += cells * sizeof(uint32_t);
+	if (m->window != NULL)
+		info->footprint += sizeof(map2_window_t) + cells * sizeof(map2_window_cell_t);
+	if (m->slab != NULL)
+		info->footprint += sizeof(map2_slab_t) + (size_t)m->slab->count * (m->slab->size + 2 * sizeof(uint32_t) + sizeof(uint16_t));
+	if (m->history != NULL)
+		info->footprint += sizeof(map2_history_t) + cells * (1 + (size_t)m->history->depth * m->history->words) * sizeof(uint32_t);
+	if (m->adapt != NULL)
+		info->footprint += sizeof(map2_adapt_t) + (size_t)m->rows * (sizeof(uint8_t) + 2 * sizeof(uint32_t)) + keys * sizeof(uint32_t);
+	
+	return true;
+}
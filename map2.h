@@ -1,310 +1,1659 @@
-/**
-	@file map2.h
-	@brief Header map2
-	
-	Mapas com controle de acesso via mutex, permitindo acesso seguro em modo
-	somente leitura ou leitura/escrita.
-	
-	Modo somente leitura: a tarefa que precisa apenas consultar dados do mapa
-	reserva o acesso apenas para copiar esses dados, logo em seguida o acesso
-	ser liberado para as demais tarefas.
-	Neste modo o acesso ao mapa fica reservado por um curto perodo de tempo.
-	Outras tarefas podero alterar os dados do mapa, porm os dados no sero
-	replicados para o item copiado. Dados alterados no item copiado tambm no
-	sero replicados para o mapa.
-	
-	Modo leitura/escrive: o mapa permanece reservado para a tarefa que
-	requisitou o acesso, liberando o acesso para as demais tarefas somente aps
-	concluir a utilizao dos dados.
-	Meste modo o acesso ao mapa fica reservado pelo tempo em que a tarefa
-	necessite utilizar os dados. Nenhuma outra tarefa ir alterar os dados do
-	mapa antes que o acesso seja liberado.
-	
-	@note Funes, macros e tipos com prefixo '__' foram projetados apenas para
-	uso interno e no devem ser utilizados
-	
-	@note Funes, macros e tipos que contenham 'unsafe' no so seguros e,
-	preferencialmente, no devem ser utilizados. Exceto na inicializao do mapa
-	com map2_init(..), onde poder ser utilizado map2_unsafe_foreach(..) para
-	inicializar cada item do mapa.
-	Mesmo assim garanta que no haver outras tarefas acessando o mapa alm da
-	tarefa que esta inicializando.
-*/
-
-#ifndef __MAP2_H__
-#define __MAP2_H__
-
-#include <RTL.h>
-#include <stdint.h>
-#include <stdbool.h>
-#include <string.h>
-
-#ifndef MAP2_OS_MUT_CREATE
-#define MAP2_OS_MUT_CREATE(MNAME, NKEYS)	static OS_MUT __##MNAME##_mut [NKEYS];
-#endif
-
-#ifndef MAP2_OS_MUT_INIT
-#define MAP2_OS_MUT_INIT(M, KEY)			os_mut_init((void*)map2_ptr((M)->mut, (KEY), void))
-#endif
-
-#ifndef MAP2_OS_MUT_TAKE
-#define MAP2_OS_MUT_TAKE(M, KEY, TOUT)		(os_mut_wait(map2_ptr((M)->mut, (KEY), void), (TOUT)) == OS_R_TMO)
-#endif
-
-#ifndef MAP2_OS_MUT_DROP
-#define MAP2_OS_MUT_DROP(M, KEY)			os_mut_release(map2_ptr((M)->mut, (KEY), void))
-#endif
-
-/**
-	Tipo de dados correspondente ao mapa
-	Ponteiros void permite, que os itens do mapa sejam de tipo customizado
-	
-	@note No crie manualmente, utilize MAP2(..)
-*/
-typedef struct {
-	const void *data;		/** Ponteiro para o mapa */
-	const int rows;			/** Nmero de linhas */
-	const int columns;		/** Nmero de colunas */
-	const int data_size;	/** Tamanho total do mapa */
-	const int field_size;	/** Tamanho de um item */
-	const void *mut;		/** Ponteiro para o mapa de mutex */
-	const int keys;			/** Quantidade de chaves disponveis */
-}
-map2_t;
-
-/**
-	Modos de operao
-*/
-typedef enum {
-	MAP2_OP_READONLY = 0,
-	MAP2_OP_READWRITE,
-}
-map2_operation_t;
-
-/**
-	O mapa pode ser acesso por mais de uma tarefa ao mesmo tempo, desde que, os
-	itens acessados sejam diferentes
-	Podemos disponibilizar trs chaves de acesso para trs tarefas diferentes -
-	ou trs instncias da mesma tarefa -, separando o acesso a itens referentes
-	aos canais pares, mpares e de expanso
-	
-	@def MAP2_NKEYS_1 Um acesso simultneo ao mapa (qualquer canal)
-	@def MAP2_NKEYS_2 Dois acessos simultneos ao mapa (canais pares e mpares)
-	@def MAP2_NKEYS_3 Trs acessos simultneos ao mapa (canais pares, mpares e
-	expanso)
-*/
-#define MAP2_NKEYS_1		(1)
-#define MAP2_NKEYS_2		(2)
-#define MAP2_NKEYS_3		(3)
-
-/**
-	@brief Macro para criao de mapa com tipo e tamanho de dados customizados
-	
-	@param data_type Tipo de dado do mapa
-	@param mapname Nome do mapa
-	@param nrows Quantidade de linhas
-	@param ncolumns Quantidade de colunas
-	@param nkeys Quantidade de chaves para controle de acesso
-
-	@note Quantidade de linhas/colunas deve ser, no mnimo, 1
-	@note Quantidade de chaves para controle de acesso deve ser, no mnimo, 1
-	
-	Exemplo:
-		typedef struct {
-			int a;
-			int b;
-		}
-		t_t;
-		MAP2(t_t, my_map1, SLOT_MAX * SLOT_CH, SLOT_DEVICES, MAP2_NKEYS_3);
-*/
-#define MAP2(data_type, mapname, nrows, ncolumns, nkeys)	\
-	static data_type __##mapname [nrows][ncolumns];			\
-	#ifndef MAP2_CONFIG_MUT_DISABLE							\
-	static OS_MUT __##mapname##_mut [nkeys]; 				\
-	#endif													\
-	map2_t mapname = { 										\
-		.data = __##mapname, 								\
-		.rows = nrows,										\
-		.columns = ncolumns,								\
-		.data_size = sizeof(__##mapname),					\
-		.field_size = sizeof(data_type),					\
-		.mut = __##mapname##_mut,							\
-		.keys = nkeys,										\
-	};
-
-/**
-	@brief Macro para importar mapas apenas pelo nome
-*/
-#define MAP2_IMPORT(mapname) \
-	extern map2_t mapname;
-
-void __map2_init(const map2_t *m);
-
-/**
-	@brief Inicializao bsica do mapa
-	
-	@param m Endereo do mapa
-	@param fnc Funo de inicializao
-	
-	Essa funo inicializa apenas o mutex de controle de acesso ao mapa
-	Outros dados podem ser iniciados implementando 'func', por exemplo:
-		map2_init(&my_map1, {
-			map2_unsafe_foreach(&my_map1, item, t_t) {
-				item->a = 0;
-				item->b = 1;
-			}
-		});
-	Ou utilizando funo de inicializao, por exemplo:
-		map2_init(&my_map1, my_map_init(&my_map1));
-*/
-#define map2_init(m, fnc) \
-	__map2_init(m); \
-	fnc;
-
-/**
-	@brief Lao para cada elemento de um mapa
-	
-	@param m Endereo do mapa
-	@param item Item (disponvel apenas dentro do lao)
-	@param type Tipo de dados do mapa
-	
-	@note No seguro! O controle de acesso no  utilizado
-*/
-#define map2_unsafe_foreach(m, item, type) \
-	for (type *item = (type*)(m)->data; item != NULL && item < (type*)((uint32_t)(m)->data + (m)->data_size); item++)
-
-/**
-	@brief Retorna a posio da linha para um item no mapa
-	
-	@param m Endereo do mapa
-	@param item Item (disponvel apenas dentro do lao)
-	@param type Tipo de dados do mapa
-	
-		map2_unsafe_foreach(&my_map1, item, t_t) {
-			int row = map2_item_row(&my_map1, item, t_t);
-		}
-	
-	@note Para ser usado com map2_unsafe_foreach()
-*/
-#define map2_item_row(m, item, type) \
-	((item - (type*)(m)->data) / (m)->columns)
-
-/**
-	@brief Retorna a posio da coluna para um item no mapa
-	
-	@param m Endereo do mapa
-	@param item Item (disponvel apenas dentro do lao)
-	@param type Tipo de dados do mapa
-	
-		map2_unsafe_foreach(&my_map1, item, t_t) {
-			int column = map2_item_column(&my_map1, item, t_t);
-		}
-	
-	@note Para ser usado com map2_unsafe_foreach()
-*/
-#define map2_item_column(m, item, type) \
-	((item - (type*)(m)->data) % (m)->columns)
-
-int map2_key(const map2_t *m, int row);
-void __map2_drop(const map2_t *m, int row, int column, int key);
-void *__map2_take(const map2_t *m, int row, int column, int key, void *dst, uint32_t tout, map2_operation_t op);
-
-/**
-	@brief Acesso seguro para leitura de um item no mapa
-	
-	@param m Endereo do mapa
-	@param row Posio do item na linha
-	@param column Posio do item na coluna
-	@param key Poisio da chave de acesso
-	@param dst Item (destido onde os dados do item sero copiados)
-	@param tout Timeout de acesso
-	@param fnc Funo executada quando o item estiver disponvel
-	@param err Funo executada quando ocorrer erro no acesso
-	
-	Exemplo:
-		for (int c = 0; c < 3; c++) {
-			for (int n = 0; n < 4; n++) {
-				int key = task_instance;
-				t_t data_ro = {0};
-				map2_readonly_trycatch(&my_map1, c, n, key, data_ro, 2000, {
-					int a = dara_ro.a;
-					int b = dara_ro.b;
-				},{
-					break;
-				});
-			}
-		}
-	
-	@note Mesmo que o item seja modificado dentro de 'func', seus dados no
-	sero replicados para o mapa
-	
-	@note O acesso ao mapa  requisitado ao chamar map2_readonly*() e liberado o
-	mais rpido possvel, antes de executar o bloco de cdigo implementado em
-	'fnc'
-	
-	@note Se o bloco de cdigo 'err' for executado, o acesso ao mapa no foi
-	alocado
-*/
-#define map2_readonly_trycatch(m, row, column, key, dst, tout, fnc, err)	\
-	if (__map2_take(m, row, column, key, &dst, tout, MAP2_OP_READONLY) != NULL) { \
-		fnc; \
-	} else { \
-		err; \
-	}
-#define map2_readonly_try(m, row, column, key, dst, tout, fnc) \
-	map2_readonly_trycatch(m, row, column, key, dst, tout, fnc, {})
-
-#define map2_readonly_trycatch2(m, row, column, key, dst, tout, fnc, err)	\
-	t_t __map2_tmp_data = {0}; \
-	if (__map2_take(m, row, column, key, &__map2_tmp_data, tout, MAP2_OP_READONLY) != NULL) { \
-		dst = (const t_t*)&__map2_tmp_data; \
-		fnc; \
-	} else { \
-		err; \
-	}
-
-/**
-	@brief Acesso seguro para escrita/leitura de um item no mapa
-	
-	@param m Endereo do mapa
-	@param row Posio do item na linha
-	@param column Posio do item na coluna
-	@param key Poisio da chave de acesso
-	@param dst Ponteiro para item (acesso direto ao mapa)
-	@param tout Timeout de acesso
-	@param fnc Funo executada quando o item estiver disponvel
-	@param err Funo executada quando ocorrer erro no acesso
-	
-	Exemplo:
-		for (int c = 0; c < 3; c++) {
-			for (int n = 0; n < 4; n++) {
-				int key = task_instance;
-				t_t *dara_rw;
-				map2_readwrite_trycatch(&my_map1, c, n, key, dara_rw, 2000, {
-					dara_rw->a *= 10;
-					dara_rw->b *= 10;
-				},{
-					break;
-				});
-			}
-		}
-	
-	@note O item  um ponteiro para o mapa
-	
-	@note O acesso ao mapa  requisitado ao chamar map2_readwrite*() e liberado
-	aps executar o bloco de cdigo implementado em 'fnc'
-	
-	@note Se o bloco de cdigo 'err' for executado, o acesso ao mapa no foi
-	alocado
-*/
-#define map2_readwrite_trycatch(m, row, column, key, dst, tout, fnc, err) \
-	if ((dst = __map2_take(m, row, column, key, dst, tout, MAP2_OP_READWRITE)) != NULL) { \
-		fnc; \
-		__map2_drop(m, row, column, key); \
-	} else { \
-		err; \
-	}
-#define map2_readwrite_try(m, row, column, key, dst, tout, fnc) \
-	map2_readwrite_trycatch(m, row, column, key, dst, tout, fnc, {})
-
-#endif
+/**
+	@file map2.h
+	@brief Header map2
+	
+	Mapas com controle de acesso via mutex, permitindo acesso seguro em modo
+	somente leitura ou leitura/escrita.
+	
+	Modo somente leitura: a tarefa que precisa apenas consultar dados do mapa
+	reserva o acesso apenas para copiar esses dados, logo em seguida o acesso
+	será liberado para as demais tarefas.
+	Neste modo o acesso ao mapa fica reservado por um curto período de tempo.
+	Outras tarefas poderão alterar os dados do mapa, porém os dados não serão
+	replicados para o item copiado. Dados alterados no item copiado também não
+	serão replicados para o mapa.
+	
+	Modo leitura/escrive: o mapa permanece reservado para a tarefa que
+	requisitou o acesso, liberando o acesso para as demais tarefas somente após
+	concluir a utilização dos dados.
+	Meste modo o acesso ao mapa fica reservado pelo tempo em que a tarefa
+	necessite utilizar os dados. Nenhuma outra tarefa irá alterar os dados do
+	mapa antes que o acesso seja liberado.
+	
+	@note Funções, macros e tipos com prefixo '__' foram projetados apenas para
+	uso interno e não devem ser utilizados
+	
+	@note Funções, macros e tipos que contenham 'unsafe' não são seguros e,
+	preferencialmente, não devem ser utilizados. Exceto na inicialização do mapa
+	com map2_init(..), onde poderá ser utilizado map2_unsafe_foreach(..) para
+	inicializar cada item do mapa.
+	Mesmo assim garanta que não haverá outras tarefas acessando o mapa além da
+	tarefa que esta inicializando.
+*/
+
+#ifndef __MAP2_H__
+#define __MAP2_H__
+
+#ifdef MAP2_CONFIG_SIM
+#include "map2_sim.h"
+#else
+#include <RTL.h>
+#endif
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+	Macros assert
+	
+	Exemplos:
+		
+		MAP2_ASSERT(ptr == NULL, return false);
+		MAP2_ASSERT(ptr == NULL, return);
+		MAP2_ASSERT(ptr == NULL, {
+			printr("null ptr");
+			return false;
+		});
+	
+	
+*/
+#define MAP2_ASSERT(cond, ret)		if (cond) ret;
+
+/**
+	@def map2_ptr Ponteiro um campo no mapa
+	@def map2_val Valor de um campo no mapa
+	@def map2_pos Cálculo de posição pela linha e coluna
+	@def map2_mut Ponteiro para o mutex de uma chave de acesso
+	
+	Os dados sempre são organizados como um vetor simples, como se
+	houvesse apenas uma linha (a menos que algum muito estranho aconteça):
+	[r0-c0][r0-c1][r0-c2] [r1-c0][r1-c1][r1-c2] [r2-c0][r2-c1][r2-c2]
+	Tudo isso alinhado conforme a arquitetura
+	Assim, podemos fazer o acesso ao mapa através de um ponteiro simples
+	
+	@note A aritmética é feita sobre 'char*' e o deslocamento em 'size_t', assim
+	os endereços não são truncados em arquiteturas 64 bits (host) e mapas
+	maiores que 2 GiB são suportados
+*/
+#define map2_ptr(var, pos, type)	((type*)((char*)(uintptr_t)(var) + (size_t)(pos)))
+#define map2_val(var, pos, type)	(*map2_ptr(var, pos, type))
+#define map2_pos(m, row, column)	(((size_t)(column) + (size_t)(m)->columns * (size_t)(row)) * (m)->field_size)
+#define map2_mut(m, key)			((void*)&((OS_MUT*)(uintptr_t)(m)->mut)[(key)])
+
+/**
+	@def MAP2_DATA_ATTR Atributos aplicados ao vetor de dados criado por MAP2(..)
+	
+	Com MAP2_CONFIG_HOST_HUGEPAGE definido com o tamanho da página grande do
+	host (ex.: -DMAP2_CONFIG_HOST_HUGEPAGE=0x200000), os dados são alinhados à
+	página grande para que map2_host_hugepage(..) possa utilizá-la (ver
+	map2_host.h)
+*/
+#ifndef MAP2_DATA_ATTR
+#ifdef MAP2_CONFIG_HOST_HUGEPAGE
+#define MAP2_DATA_ATTR						__attribute__((aligned(MAP2_CONFIG_HOST_HUGEPAGE)))
+#else
+#define MAP2_DATA_ATTR
+#endif
+#endif
+
+/**
+	Trava rápida por chave (MAP2_FAST ou MAP2_CONFIG_LOCK_FAST)
+	
+	Com MAP2_CONFIG_LOCK_FAST definido, MAP2(..), MAP2_KEYMAP(..) e
+	MAP2_ADAPTIVE(..) utilizam a trava rápida no lugar de OS_MUT em todas as
+	chaves
+*/
+#ifdef MAP2_CONFIG_LOCK_FAST
+#define MAP2_FAST_CREATE(MNAME, NKEYS)		static uint32_t __##MNAME##_fast [NKEYS];
+#define MAP2_FAST_REF(MNAME)				__##MNAME##_fast
+#define MAP2_OS_MUT_CREATE(MNAME, NKEYS)
+#define MAP2_OS_MUT_REF(MNAME)				NULL
+#else
+#define MAP2_FAST_CREATE(MNAME, NKEYS)
+#define MAP2_FAST_REF(MNAME)				NULL
+#endif
+
+#if defined(MAP2_CONFIG_MUT_DISABLE) && !defined(MAP2_CONFIG_LOCK_FAST)
+#define MAP2_OS_MUT_CREATE(MNAME, NKEYS)
+#define MAP2_OS_MUT_REF(MNAME)				NULL
+#endif
+
+#ifndef MAP2_OS_MUT_CREATE
+#define MAP2_OS_MUT_CREATE(MNAME, NKEYS)	static OS_MUT __##MNAME##_mut [NKEYS];
+#endif
+
+#ifndef MAP2_OS_MUT_REF
+#define MAP2_OS_MUT_REF(MNAME)				__##MNAME##_mut
+#endif
+
+#ifndef MAP2_OS_MUT_INIT
+#define MAP2_OS_MUT_INIT(M, KEY)			os_mut_init(map2_mut((M), (KEY)))
+#endif
+
+#ifndef MAP2_OS_MUT_TAKE
+#define MAP2_OS_MUT_TAKE(M, KEY, TOUT)		(os_mut_wait(map2_mut((M), (KEY)), (TOUT)) == OS_R_TMO)
+#endif
+
+#ifndef MAP2_OS_MUT_DROP
+#define MAP2_OS_MUT_DROP(M, KEY)			os_mut_release(map2_mut((M), (KEY)))
+#endif
+
+/**
+	Operações atômicas utilizadas nos acessos sem mutex
+	
+	Por padrão são utilizadas as funções __atomic_* (GCC/armclang), no
+	Cortex-M3 geram LDREX/STREX. Podem ser redefinidas para outro compilador
+*/
+#ifndef MAP2_ATOMIC_LOAD
+#define MAP2_ATOMIC_LOAD(PTR)				__atomic_load_n((PTR), __ATOMIC_ACQUIRE)
+#endif
+
+#ifndef MAP2_ATOMIC_STORE
+#define MAP2_ATOMIC_STORE(PTR, VAL)			__atomic_store_n((PTR), (VAL), __ATOMIC_RELEASE)
+#endif
+
+#ifndef MAP2_ATOMIC_CAS
+#define MAP2_ATOMIC_CAS(PTR, EXP, VAL)		__atomic_compare_exchange_n((PTR), (EXP), (VAL), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#endif
+
+#ifndef MAP2_ATOMIC_FETCH_OR
+#define MAP2_ATOMIC_FETCH_OR(PTR, VAL)		__atomic_fetch_or((PTR), (VAL), __ATOMIC_ACQ_REL)
+#endif
+
+#ifndef MAP2_ATOMIC_FETCH_AND
+#define MAP2_ATOMIC_FETCH_AND(PTR, VAL)		__atomic_fetch_and((PTR), (VAL), __ATOMIC_ACQ_REL)
+#endif
+
+#ifndef MAP2_ATOMIC_XCHG
+#define MAP2_ATOMIC_XCHG(PTR, VAL)			__atomic_exchange_n((PTR), (VAL), __ATOMIC_ACQ_REL)
+#endif
+
+#ifndef MAP2_ATOMIC_FETCH_ADD
+#define MAP2_ATOMIC_FETCH_ADD(PTR, VAL)		__atomic_fetch_add((PTR), (VAL), __ATOMIC_RELAXED)
+#endif
+
+#ifndef MAP2_ATOMIC_FENCE
+#define MAP2_ATOMIC_FENCE()					__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/**
+	@def MAP2_CPU_RELAX Pausa entre tentativas de obter uma trava por item
+	@def MAP2_OS_DELAY Aguarda uma quantidade de ticks, liberando o processador
+	para tarefas de menor prioridade
+*/
+#ifndef MAP2_CPU_RELAX
+#if defined(__x86_64__) || defined(__i386__)
+#define MAP2_CPU_RELAX()					__builtin_ia32_pause()
+#else
+#define MAP2_CPU_RELAX()					__asm volatile ("" ::: "memory")
+#endif
+#endif
+
+#ifndef MAP2_OS_DELAY
+#define MAP2_OS_DELAY(TICKS)				os_dly_wait(TICKS)
+#endif
+
+/**
+	Trava por item, utilizada pelos mapas criados com MAP2_CELL(..)
+	
+	Por padrão ocupa 1 byte por item. Com MAP2_CONFIG_CELL_LOCK_WORD definido
+	ocupa 4 bytes, para arquiteturas sem acesso atômico a bytes
+*/
+#ifdef MAP2_CONFIG_CELL_LOCK_WORD
+typedef uint32_t map2_cell_lock_t;
+#else
+typedef uint8_t map2_cell_lock_t;
+#endif
+
+/**
+	Histograma de latência
+	
+	Os valores são agrupados por potência de 2, cada potência dividida em
+	2^MAP2_CONFIG_HIST_SUB partes iguais. Com o padrão (2) o erro de um
+	percentil é de no máximo 25%
+	
+	@def MAP2_HIST_BUCKETS Quantidade de posições do histograma
+*/
+#ifndef MAP2_CONFIG_HIST_SUB
+#define MAP2_CONFIG_HIST_SUB	(2)
+#endif
+
+#define MAP2_HIST_BUCKETS		((33 - MAP2_CONFIG_HIST_SUB) << MAP2_CONFIG_HIST_SUB)
+
+typedef struct {
+	uint32_t count[MAP2_HIST_BUCKETS];	/** Quantidade de valores em cada posição */
+}
+map2_hist_t;
+
+/**
+	Estatísticas de acesso de uma chave
+	
+	Com MAP2_CONFIG_STATS definido os mapas registram as estatísticas de cada
+	chave de acesso. Uma disputa é contabilizada quando a chave não está livre
+	no momento do acesso
+	
+	Com MAP2_CONFIG_STATS_HIST definido também são registrados os histogramas
+	do tempo aguardando e do tempo com a chave alocada, em unidades de
+	MAP2_TIMESTAMP() (nanossegundos no host, ticks no RTOS). Acessos que
+	aguardaram mais que MAP2_CONFIG_STATS_DEADLINE são contabilizados em 'late'
+	
+	@note O tempo com a chave alocada não é registrado em mapas com trava por
+	item (MAP2_CELL)
+	
+	@note Todos os campos são uint32_t, somados campo a campo por map2_stats(..)
+*/
+typedef struct {
+	uint32_t acquisitions;	/** Acessos alocados */
+	uint32_t contended;		/** Acessos que aguardaram a chave */
+	uint32_t timeouts;		/** Acessos não alocados (timeout) */
+#ifdef MAP2_CONFIG_STATS_HIST
+	uint32_t late;			/** Acessos que aguardaram mais que o prazo */
+	uint32_t taken;			/** Instante da última alocação (uso interno) */
+	map2_hist_t wait;		/** Tempo aguardando a chave */
+	map2_hist_t hold;		/** Tempo com a chave alocada */
+#endif
+}
+map2_stats_t;
+
+#ifdef MAP2_CONFIG_STATS
+#define MAP2_STATS_CREATE(MNAME, NKEYS)		static map2_stats_t __##MNAME##_stats [NKEYS];
+#define MAP2_STATS_REF(MNAME)				__##MNAME##_stats
+#else
+#define MAP2_STATS_CREATE(MNAME, NKEYS)
+#define MAP2_STATS_REF(MNAME)				NULL
+#endif
+
+/**
+	Dono de uma chave, utilizado na verificação de exclusão mútua
+	
+	Com MAP2_CONFIG_CHECK definido cada alocação e liberação de chave é
+	verificada: duas tarefas com a mesma chave ao mesmo tempo, liberação por
+	tarefa que não possui a chave ou, trava rápida alocada novamente pela mesma
+	tarefa (deadlock). Cada violação gera mensagem de debug e é contabilizada
+	em map2_check_violations(..)
+	
+	@note Destinado a testes de estresse, não utilize em produção
+	@note Mapas com trava por item (MAP2_CELL) não são verificados
+*/
+typedef struct {
+	OS_TID task;			/** Tarefa que possui a chave */
+	uint32_t depth;			/** Alocações aninhadas da chave */
+}
+map2_owner_t;
+
+#ifdef MAP2_CONFIG_CHECK
+#define MAP2_CHECK_CREATE(MNAME, NKEYS)		static map2_owner_t __##MNAME##_owner [NKEYS];
+#define MAP2_CHECK_REF(MNAME)				__##MNAME##_owner
+#else
+#define MAP2_CHECK_CREATE(MNAME, NKEYS)
+#define MAP2_CHECK_REF(MNAME)				NULL
+#endif
+
+/**
+	Amostra de acesso ao mapa
+	
+	Com MAP2_CONFIG_SAMPLE definido __map2_take(..) registra um acesso a cada
+	'every' acessos de cada chave ou, todo acesso que aguardou mais que 'wait'
+	unidades de MAP2_TIMESTAMP(), ver map2_sample_config(..). As amostras são gravadas em
+	um buffer circular sem trava, de MAP2_CONFIG_SAMPLE_DEPTH posições, lido
+	com map2_sample_read(..)
+	
+	@note O tempo com a chave alocada não é registrado em mapas com trava por
+	item (MAP2_CELL)
+*/
+typedef struct {
+	uint32_t seq;			/** Índice + 1 quando completa, 0 durante a escrita (uso interno) */
+	uint32_t index;			/** Índice da amostra no buffer */
+	uintptr_t site;			/** Endereço de onde o acesso foi requisitado */
+	const void *map;		/** Endereço do mapa (map2_t) */
+	int32_t row;			/** Posição do item na linha */
+	int32_t column;			/** Posição do item na coluna, -1 para a linha inteira */
+	int8_t key;				/** Posição da chave de acesso */
+	uint8_t op;				/** Modo de operação */
+	uint32_t stamp;			/** Instante da alocação */
+	uint32_t wait;			/** Tempo aguardando a chave */
+	uint32_t hold;			/** Tempo com a chave alocada */
+}
+map2_sample_t;
+
+/**
+	Estado da amostragem de cada chave do mapa (uso interno)
+*/
+typedef struct {
+	uint32_t pending;		/** Índice + 1 da amostra pendente, protegido pela chave */
+	uint32_t countdown;		/** Acessos até a próxima amostra */
+}
+map2_sample_key_t;
+
+#ifdef MAP2_CONFIG_SAMPLE
+#define MAP2_SAMPLE_CREATE(MNAME, NKEYS)	static map2_sample_key_t __##MNAME##_sample [NKEYS];
+#define MAP2_SAMPLE_REF(MNAME)				__##MNAME##_sample
+#else
+#define MAP2_SAMPLE_CREATE(MNAME, NKEYS)
+#define MAP2_SAMPLE_REF(MNAME)				NULL
+#endif
+
+/**
+	Registro de acesso ao mapa
+	
+	Com MAP2_CONFIG_RECORD definido e a gravação habilitada com
+	map2_record_enable(..), todo acesso alocado é registrado em um buffer
+	circular sem trava, de MAP2_CONFIG_RECORD_DEPTH posições, lido com
+	map2_record_read(..). No host os registros podem ser gravados em arquivo
+	e reproduzidos em outra configuração do mapa, ver map2_host_replay(..)
+	
+	@note O tempo com a chave alocada não é registrado em mapas com trava por
+	item (MAP2_CELL)
+	@note A posição do mapa ocupa 8 bits, com MAP2_CONFIG_RECORD o registro
+	aceita no máximo 255 mapas (MAP2_CONFIG_REGISTRY_MAX)
+*/
+typedef struct {
+	uint32_t stamp;			/** Instante da alocação, em unidades de MAP2_TIMESTAMP() */
+	uint32_t hold;			/** Tempo com a chave alocada */
+	uint16_t task;			/** Tarefa que alocou a chave (os_tsk_self) */
+	uint8_t map;			/** Posição do mapa no registro, ver map2_registry_get(..), 0xFF quando não registrado */
+	uint8_t op;				/** Modo de operação */
+	int32_t row;			/** Posição do item na linha */
+	int32_t column;			/** Posição do item na coluna, -1 para a linha inteira */
+}
+map2_record_t;
+
+#ifdef MAP2_CONFIG_RECORD
+#define MAP2_RECORD_CREATE(MNAME, NKEYS)	static uint32_t __##MNAME##_record [NKEYS];
+#define MAP2_RECORD_REF(MNAME)				__##MNAME##_record
+#else
+#define MAP2_RECORD_CREATE(MNAME, NKEYS)
+#define MAP2_RECORD_REF(MNAME)				NULL
+#endif
+
+/**
+	Campo de um item do mapa, utilizado em map2_project(..) e MAP2_HISTORY_FIELD(..)
+	
+	@def MAP2_FIELD Descritor de um membro do tipo de dados do mapa
+	@def MAP2_FIELDS Lista de descritores e sua quantidade, para os argumentos
+	'fields' e 'n' de map2_project(..)
+	
+	Exemplo:
+		MAP2_FIELD(t_t, status)
+		MAP2_FIELDS(MAP2_FIELD(t_t, status), MAP2_FIELD(t_t, value))
+*/
+typedef struct {
+	uint32_t offset;		/** Deslocamento do campo no item */
+	uint32_t size;			/** Tamanho do campo */
+}
+map2_field_t;
+
+#define MAP2_FIELD(type, member)	\
+	((map2_field_t){ .offset = (uint32_t)offsetof(type, member), .size = (uint32_t)sizeof(((type*)0)->member) })
+
+#define MAP2_FIELDS(...)			\
+	((const map2_field_t[]){ __VA_ARGS__ }), (int)(sizeof((const map2_field_t[]){ __VA_ARGS__ }) / sizeof(map2_field_t))
+
+/**
+	Instante da última escrita de cada item
+	
+	Com MAP2_CONFIG_STAMP definido cada item guarda o tick (os_time_get) da sua
+	última escrita, ver map2_age(..), map2_stale(..) e map2_readonly_age_try(..)
+	
+	@def MAP2_AGE_NEVER Idade de um item nunca escrito
+	
+	@note O tick 0 é gravado como 1, 0 indica item nunca escrito
+*/
+#ifdef MAP2_CONFIG_STAMP
+#define MAP2_STAMP_CREATE(MNAME, NROWS, NCOLUMNS)	static uint32_t __##MNAME##_stamp [(NROWS) * (NCOLUMNS)];
+#define MAP2_STAMP_REF(MNAME)				__##MNAME##_stamp
+#else
+#define MAP2_STAMP_CREATE(MNAME, NROWS, NCOLUMNS)
+#define MAP2_STAMP_REF(MNAME)				NULL
+#endif
+
+#define MAP2_AGE_NEVER		(0xFFFFFFFFu)
+
+/**
+	Histórico de valores de cada item (MAP2_HISTORY)
+	
+	Cada item possui 'depth' posições circulares, cada uma com o instante da
+	escrita (MAP2_TIMESTAMP) seguido de uma cópia completa do valor, sem
+	codificação por diferença (delta). O valor é o item inteiro ou, com
+	MAP2_HISTORY_FIELD(..), apenas um campo, reduzindo a memória
+	
+	'seq' é um seqlock por item: ímpar durante a escrita, e metade do seu
+	valor é a quantidade de escritas do item, ver map2_history_read(..)
+	
+	@note Não crie manualmente, utilize MAP2_HISTORY(..)
+*/
+typedef struct {
+	uint32_t *const seq;		/** Seqlock de cada item */
+	uint32_t *const ring;		/** Posições de todos os itens */
+	const uint16_t depth;		/** Posições por item */
+	const uint16_t words;		/** Palavras de uma posição, instante e valor */
+	const map2_field_t field;	/** Campo gravado, tamanho 0 para o item inteiro */
+}
+map2_history_t;
+
+/**
+	Estatísticas por janela de um campo numérico de cada item (MAP2_WINDOW)
+	
+	Cada item guarda duas janelas de 'window' ticks, a atual e a anterior,
+	atualizadas em O(1) a cada escrita. O mínimo e o máximo cobrem as duas
+	janelas, ou seja, entre 'window' e 2 * 'window' ticks de valores
+	
+	@note Não crie manualmente, utilize MAP2_WINDOW(..)
+*/
+typedef struct {
+	uint32_t seq;			/** Seqlock */
+	uint32_t start;			/** Tick de início da janela atual */
+	int32_t last;			/** Último valor */
+	int32_t min[2];			/** Mínimo da janela atual [0] e anterior [1] */
+	int32_t max[2];			/** Máximo da janela atual [0] e anterior [1] */
+	uint32_t count[2];		/** Escritas da janela atual [0] e anterior [1] */
+	int64_t ema;			/** Média móvel exponencial, ponto fixo Q8 */
+}
+map2_window_cell_t;
+
+typedef struct {
+	map2_window_cell_t *const cells;	/** Estado de cada item */
+	int32_t (*const get)(const void *item);	/** Lê o campo do item */
+	const uint32_t window;	/** Duração de uma janela, em ticks */
+	const uint8_t shift;	/** Peso da média móvel, 1 / 2^shift */
+}
+map2_window_t;
+
+/**
+	Estatísticas de um item, ver map2_window_read(..)
+*/
+typedef struct {
+	int32_t last;			/** Último valor */
+	int32_t min;			/** Menor valor nas duas últimas janelas */
+	int32_t max;			/** Maior valor nas duas últimas janelas */
+	int32_t ema;			/** Média móvel exponencial, arredondada */
+	uint32_t count;			/** Escritas na janela atual */
+	uint32_t rate;			/** Escritas na última janela completa */
+	uint32_t total;			/** Escritas consideradas em min e max */
+}
+map2_window_stats_t;
+
+/**
+	Pool de blocos dos itens indiretos (MAP2_INDIRECT)
+	
+	Cada bloco possui um contador de referências. O bloco retorna à lista de
+	livres quando a última referência é liberada. Blocos nunca utilizados são
+	obtidos a partir de 'used', assim o pool zerado é válido sem inicialização
+	
+	'free' é o topo da lista de livres: índice + 1 nos 16 bits menos
+	significativos e um contador de trocas nos 16 bits mais significativos,
+	evitando o problema ABA
+	
+	@note Não crie manualmente, utilize MAP2_INDIRECT(..)
+*/
+typedef struct {
+	uint8_t *const blocks;	/** Blocos de 'size' bytes */
+	uint32_t *const ref;	/** Referências de cada bloco, 0 quando livre */
+	uint32_t *const length;	/** Bytes ocupados de cada bloco */
+	uint16_t *const next;	/** Próximo bloco da lista de livres, índice + 1 */
+	const uint32_t size;	/** Tamanho de um bloco */
+	const uint16_t count;	/** Quantidade de blocos */
+	uint32_t free;			/** Topo da lista de livres */
+	uint32_t used;			/** Blocos já utilizados ao menos uma vez */
+}
+map2_slab_t;
+
+/**
+	Estado do remapeamento adaptativo de chaves (MAP2_ADAPTIVE)
+	
+	@note Não crie manualmente, utilize MAP2_ADAPTIVE(..)
+*/
+typedef struct {
+	uint8_t *const table;	/** Chave + 1 de cada linha, 0 para a distribuição inicial */
+	uint32_t *const hits;	/** Disputas de cada linha desde o último remapeamento */
+	uint32_t *const order;	/** Linhas ordenadas por disputas (uso interno) */
+	uint32_t *const load;	/** Disputas atribuídas a cada chave (uso interno) */
+	uint32_t restripes;		/** Quantidade de remapeamentos */
+	uint32_t stripes;		/** Chaves utilizadas no último remapeamento, 0 antes do primeiro */
+	map2_stats_t before;	/** Totais do período anterior ao último remapeamento */
+	uint32_t before_max;	/** Maior quantidade de disputas de uma chave no período anterior */
+}
+map2_adapt_t;
+
+/**
+	Contenção antes e depois do último remapeamento, ver map2_adapt_report(..)
+*/
+typedef struct {
+	uint32_t restripes;		/** Quantidade de remapeamentos */
+	uint32_t stripes;		/** Chaves utilizadas atualmente */
+	map2_stats_t before;	/** Totais do período anterior ao último remapeamento */
+	uint32_t before_max;	/** Maior quantidade de disputas de uma chave antes */
+	map2_stats_t after;		/** Totais desde o último remapeamento */
+	uint32_t after_max;		/** Maior quantidade de disputas de uma chave depois */
+}
+map2_adapt_report_t;
+
+/**
+	Estado da inicialização de um mapa, válido zerado
+	
+	@note Não crie manualmente, utilize MAP2(..)
+*/
+typedef struct {
+	uint32_t state;			/** Estado da inicialização, ver map2_init(..) */
+	uint32_t index;			/** Posição no registro + 1, 0 quando não registrado */
+}
+map2_ready_t;
+
+/**
+	Tipo de dados correspondente ao mapa
+	Ponteiros void permite, que os itens do mapa sejam de tipo customizado
+	
+	@note Não crie manualmente, utilize MAP2(..)
+*/
+typedef struct map2_keymap map2_keymap_t;
+
+typedef struct {
+	const void *data;		/** Ponteiro para o mapa */
+	const char *const name;	/** Nome do mapa */
+	const char *const type;	/** Nome do tipo de dados do mapa */
+	map2_ready_t *const ready;	/** Estado da inicialização, ver map2_init(..) */
+	const int rows;			/** Número de linhas */
+	const int columns;		/** Número de colunas */
+	const size_t data_size;	/** Tamanho total do mapa */
+	const size_t field_size;/** Tamanho de um item */
+	const void *mut;		/** Ponteiro para o mapa de mutex */
+	const int keys;			/** Quantidade de chaves disponíveis */
+	map2_cell_lock_t *const lck;	/** Ponteiro para o mapa de travas por item (MAP2_CELL) */
+	const map2_keymap_t *const keymap;	/** Política de chaves, NULL para map2_keymap_slots */
+	map2_stats_t *const stats;	/** Estatísticas de cada chave (MAP2_CONFIG_STATS) */
+	map2_adapt_t *const adapt;	/** Remapeamento adaptativo de chaves (MAP2_ADAPTIVE) */
+	uint32_t *const fast;	/** Ponteiro para o mapa de travas rápidas por chave (MAP2_FAST) */
+	map2_owner_t *const owner;	/** Dono de cada chave (MAP2_CONFIG_CHECK) */
+	map2_sample_key_t *const sample;	/** Amostragem de cada chave (MAP2_CONFIG_SAMPLE) */
+	uint32_t *const record;	/** Registro pendente de cada chave (MAP2_CONFIG_RECORD) */
+	map2_history_t *const history;	/** Histórico de valores de cada item (MAP2_HISTORY) */
+	uint32_t *const stamp;	/** Tick da última escrita de cada item (MAP2_CONFIG_STAMP) */
+	map2_window_t *const window;	/** Estatísticas por janela de cada item (MAP2_WINDOW) */
+	map2_slab_t *const slab;	/** Pool de blocos dos itens indiretos (MAP2_INDIRECT) */
+}
+map2_t;
+
+/**
+	Tipo de controle de acesso do mapa
+	
+	@def MAP2_LOCK_NONE Sem controle de acesso (MAP2_CONFIG_MUT_DISABLE)
+	@def MAP2_LOCK_MUTEX OS_MUT por chave
+	@def MAP2_LOCK_CELL Trava por item (MAP2_CELL)
+	@def MAP2_LOCK_FAST Trava rápida por chave (MAP2_FAST)
+*/
+typedef enum {
+	MAP2_LOCK_NONE = 0,
+	MAP2_LOCK_MUTEX,
+	MAP2_LOCK_CELL,
+	MAP2_LOCK_FAST,
+}
+map2_lock_mode_t;
+
+/**
+	Configuração e uso de memória de um mapa, ver map2_info(..)
+*/
+typedef struct {
+	const char *name;		/** Nome do mapa */
+	const char *type;		/** Nome do tipo de dados do mapa */
+	int rows;				/** Número de linhas */
+	int columns;			/** Número de colunas */
+	int keys;				/** Quantidade de chaves */
+	size_t field_size;		/** Tamanho de um item */
+	size_t row_size;		/** Tamanho de uma linha (linhas contíguas) */
+	size_t data_size;		/** Tamanho dos dados */
+	size_t footprint;		/** Memória total: dados, travas e estruturas opcionais */
+	map2_lock_mode_t lock;	/** Tipo de controle de acesso */
+	bool keymap;			/** Possui política de chaves (MAP2_KEYMAP) */
+	bool adaptive;			/** Remapeamento adaptativo (MAP2_ADAPTIVE) */
+	bool stats;				/** Possui estatísticas (MAP2_CONFIG_STATS) */
+}
+map2_info_t;
+
+/**
+	Modos de operação
+*/
+typedef enum {
+	MAP2_OP_READONLY = 0,
+	MAP2_OP_READWRITE,
+}
+map2_operation_t;
+
+/**
+	O mapa pode ser acesso por mais de uma tarefa ao mesmo tempo, desde que, os
+	itens acessados sejam diferentes
+	Podemos disponibilizar três chaves de acesso para três tarefas diferentes -
+	ou três instâncias da mesma tarefa -, separando o acesso a itens referentes
+	aos canais pares, ímpares e de expansão
+	
+	@def MAP2_NKEYS_1 Um acesso simultâneo ao mapa (qualquer canal)
+	@def MAP2_NKEYS_2 Dois acessos simultâneos ao mapa (canais pares e ímpares)
+	@def MAP2_NKEYS_3 Três acessos simultâneos ao mapa (canais pares, ímpares e
+	expansão)
+*/
+#define MAP2_NKEYS_1		(1)
+#define MAP2_NKEYS_2		(2)
+#define MAP2_NKEYS_3		(3)
+
+/**
+	Política de chaves de acesso, define a chave de cada linha do mapa
+	
+	@note Utilize MAP2_KEYMAP_*(..)
+*/
+struct map2_keymap {
+	int (*key)(const map2_keymap_t *km, int row, int keys);	/** Chave da linha */
+	int arg;					/** Parâmetro da política */
+	const uint8_t *table;		/** Tabela linha/chave (MAP2_KEYMAP_TABLE) */
+};
+
+int map2_keymap_slots(const map2_keymap_t *km, int row, int keys);
+int map2_keymap_modulo(const map2_keymap_t *km, int row, int keys);
+int map2_keymap_range(const map2_keymap_t *km, int row, int keys);
+int map2_keymap_hash(const map2_keymap_t *km, int row, int keys);
+int map2_keymap_table(const map2_keymap_t *km, int row, int keys);
+int map2_keymap_adaptive(const map2_keymap_t *km, int row, int keys);
+
+/**
+	Políticas de chaves de acesso
+	
+	@def MAP2_KEYMAP_SLOTS Canais pares, ímpares e expansão (padrão, ver
+	map2_key(..))
+	@def MAP2_KEYMAP_MODULO Linhas distribuídas alternadamente entre as chaves
+	(linha % chaves)
+	@def MAP2_KEYMAP_RANGE Faixas contíguas de 'nrows' linhas por chave
+	@def MAP2_KEYMAP_HASH Linhas espalhadas entre as chaves por hash
+	@def MAP2_KEYMAP_TABLE Chave de cada linha definida em 'tbl' (uint8_t[])
+	@def MAP2_KEYMAP_ADAPTIVE Tabela de MAP2_ADAPTIVE(..), chave + 1 de cada
+	linha ou 0 para linha % 'nstripes' (uso interno)
+	
+	Exemplo:
+		static const uint8_t my_keys[8] = {0, 0, 1, 1, 1, 2, 2, 2};
+		MAP2_KEYMAP(t_t, my_map3, 8, SLOT_DEVICES, MAP2_NKEYS_3, MAP2_KEYMAP_TABLE(my_keys));
+*/
+#define MAP2_KEYMAP_SLOTS()			(&(const map2_keymap_t){ map2_keymap_slots, 0, NULL })
+#define MAP2_KEYMAP_MODULO()		(&(const map2_keymap_t){ map2_keymap_modulo, 0, NULL })
+#define MAP2_KEYMAP_RANGE(nrows)	(&(const map2_keymap_t){ map2_keymap_range, (nrows), NULL })
+#define MAP2_KEYMAP_HASH()			(&(const map2_keymap_t){ map2_keymap_hash, 0, NULL })
+#define MAP2_KEYMAP_TABLE(tbl)		(&(const map2_keymap_t){ map2_keymap_table, 0, (tbl) })
+#define MAP2_KEYMAP_ADAPTIVE(tbl, nstripes)	(&(const map2_keymap_t){ map2_keymap_adaptive, (nstripes), (tbl) })
+
+/**
+	@brief Macro para criação de mapa com tipo e tamanho de dados customizados
+	
+	@param data_type Tipo de dado do mapa
+	@param mapname Nome do mapa
+	@param nrows Quantidade de linhas
+	@param ncolumns Quantidade de colunas
+	@param nkeys Quantidade de chaves para controle de acesso
+
+	@note Quantidade de linhas/colunas deve ser, no mínimo, 1
+	@note Quantidade de chaves para controle de acesso deve ser, no mínimo, 1
+	
+	Exemplo:
+		typedef struct {
+			int a;
+			int b;
+		}
+		t_t;
+		MAP2(t_t, my_map1, SLOT_MAX * SLOT_CH, SLOT_DEVICES, MAP2_NKEYS_3);
+*/
+#define MAP2(data_type, mapname, nrows, ncolumns, nkeys)	\
+	MAP2_KEYMAP(data_type, mapname, nrows, ncolumns, nkeys, NULL)
+
+/**
+	@brief Macro para criação de mapa com política de chaves de acesso
+	
+	@param data_type Tipo de dado do mapa
+	@param mapname Nome do mapa
+	@param nrows Quantidade de linhas
+	@param ncolumns Quantidade de colunas
+	@param nkeys Quantidade de chaves para controle de acesso
+	@param policy Política de chaves, MAP2_KEYMAP_*(..) ou NULL para
+	MAP2_KEYMAP_SLOTS()
+	
+	Permite alinhar as chaves às tarefas que realmente disputam o acesso em
+	cada produto. map2_init(..) verifica se todas as linhas possuem chave
+	válida, ver map2_keymap_check(..)
+	
+	Exemplo:
+		MAP2_KEYMAP(t_t, my_map2, 64, SLOT_DEVICES, 4, MAP2_KEYMAP_RANGE(16));
+*/
+#define MAP2_KEYMAP(data_type, mapname, nrows, ncolumns, nkeys, policy)	\
+	static data_type __##mapname [nrows][ncolumns] MAP2_DATA_ATTR;	\
+	MAP2_OS_MUT_CREATE(mapname, nkeys)						\
+	MAP2_FAST_CREATE(mapname, nkeys)						\
+	MAP2_STATS_CREATE(mapname, nkeys)						\
+	MAP2_CHECK_CREATE(mapname, nkeys)						\
+	MAP2_SAMPLE_CREATE(mapname, nkeys)						\
+	MAP2_RECORD_CREATE(mapname, nkeys)						\
+	MAP2_STAMP_CREATE(mapname, nrows, ncolumns)				\
+	static map2_ready_t __##mapname##_ready;				\
+	map2_t mapname = { 										\
+		.data = __##mapname, 								\
+		.name = #mapname,									\
+		.type = #data_type,									\
+		.ready = &__##mapname##_ready,						\
+		.rows = nrows,										\
+		.columns = ncolumns,								\
+		.data_size = sizeof(__##mapname),					\
+		.field_size = sizeof(data_type),					\
+		.mut = MAP2_OS_MUT_REF(mapname),					\
+		.keys = nkeys,										\
+		.keymap = policy,									\
+		.stats = MAP2_STATS_REF(mapname),					\
+		.owner = MAP2_CHECK_REF(mapname),					\
+		.sample = MAP2_SAMPLE_REF(mapname),					\
+		.record = MAP2_RECORD_REF(mapname),					\
+		.stamp = MAP2_STAMP_REF(mapname),					\
+		.fast = MAP2_FAST_REF(mapname),						\
+	};
+
+/**
+	@brief Macro para criação de mapa com trava por item
+	
+	@param data_type Tipo de dado do mapa
+	@param mapname Nome do mapa
+	@param nrows Quantidade de linhas
+	@param ncolumns Quantidade de colunas
+	
+	Cada item possui sua própria trava (map2_cell_lock_t), obtida com
+	test-and-set atômico. Itens diferentes nunca disputam o acesso e a memória
+	das travas é proporcional ao mapa, sem utilizar OS_MUT
+	
+	Enquanto a trava estiver ocupada a tarefa tenta novamente
+	MAP2_CONFIG_CELL_SPIN vezes, com pausa crescente entre as tentativas. Depois
+	disso aguarda 1 tick entre as tentativas até esgotar o timeout
+	
+	@note O mapa possui uma única chave de acesso (MAP2_NKEYS_1), assim
+	map2_key(..) continua válido
+	
+	@note Indicado para acessos curtos, a tarefa que aguarda não herda
+	prioridade como no mutex
+	
+	Exemplo:
+		MAP2_CELL(t_t, my_map2, SLOT_MAX * SLOT_CH, SLOT_DEVICES);
+*/
+#define MAP2_CELL(data_type, mapname, nrows, ncolumns)		\
+	static data_type __##mapname [nrows][ncolumns] MAP2_DATA_ATTR;	\
+	static map2_cell_lock_t __##mapname##_lck [nrows][ncolumns];	\
+	MAP2_STATS_CREATE(mapname, MAP2_NKEYS_1)				\
+	MAP2_STAMP_CREATE(mapname, nrows, ncolumns)				\
+	static map2_ready_t __##mapname##_ready;				\
+	map2_t mapname = { 										\
+		.data = __##mapname, 								\
+		.name = #mapname,									\
+		.type = #data_type,									\
+		.ready = &__##mapname##_ready,						\
+		.rows = nrows,										\
+		.columns = ncolumns,								\
+		.data_size = sizeof(__##mapname),					\
+		.field_size = sizeof(data_type),					\
+		.mut = NULL,										\
+		.keys = MAP2_NKEYS_1,								\
+		.lck = &__##mapname##_lck[0][0],					\
+		.stats = MAP2_STATS_REF(mapname),					\
+		.stamp = MAP2_STAMP_REF(mapname),					\
+	};
+
+/**
+	@brief Macro para criação de mapa com trava rápida por chave
+	
+	@param data_type Tipo de dado do mapa
+	@param mapname Nome do mapa
+	@param nrows Quantidade de linhas
+	@param ncolumns Quantidade de colunas
+	@param nkeys Quantidade de chaves para controle de acesso
+	
+	Quando a chave está livre o acesso é alocado com uma única operação
+	atômica (CAS), sem chamar o RTOS. Somente quando a chave está em disputa a
+	tarefa aguarda (futex no host, ver MAP2_FUTEX_WAIT), mantendo o timeout
+	
+	@note A trava rápida não é recursiva e não possui herança de prioridade
+	como o OS_MUT, a mesma tarefa não pode alocar a chave duas vezes
+	
+	Exemplo:
+		MAP2_FAST(t_t, my_map5, SLOT_MAX * SLOT_CH, SLOT_DEVICES, MAP2_NKEYS_3);
+*/
+#define MAP2_FAST(data_type, mapname, nrows, ncolumns, nkeys)	\
+	static data_type __##mapname [nrows][ncolumns] MAP2_DATA_ATTR;	\
+	static uint32_t __##mapname##_fast [nkeys];				\
+	MAP2_STATS_CREATE(mapname, nkeys)						\
+	MAP2_CHECK_CREATE(mapname, nkeys)						\
+	MAP2_SAMPLE_CREATE(mapname, nkeys)						\
+	MAP2_RECORD_CREATE(mapname, nkeys)						\
+	MAP2_STAMP_CREATE(mapname, nrows, ncolumns)				\
+	static map2_ready_t __##mapname##_ready;				\
+	map2_t mapname = { 										\
+		.data = __##mapname, 								\
+		.name = #mapname,									\
+		.type = #data_type,									\
+		.ready = &__##mapname##_ready,						\
+		.rows = nrows,										\
+		.columns = ncolumns,								\
+		.data_size = sizeof(__##mapname),					\
+		.field_size = sizeof(data_type),					\
+		.mut = NULL,										\
+		.keys = nkeys,										\
+		.stats = MAP2_STATS_REF(mapname),					\
+		.owner = MAP2_CHECK_REF(mapname),					\
+		.sample = MAP2_SAMPLE_REF(mapname),					\
+		.record = MAP2_RECORD_REF(mapname),					\
+		.stamp = MAP2_STAMP_REF(mapname),					\
+		.fast = __##mapname##_fast,							\
+	};
+
+/**
+	@brief Macro para criação de mapa com remapeamento adaptativo de chaves
+	
+	@param data_type Tipo de dado do mapa
+	@param mapname Nome do mapa
+	@param nrows Quantidade de linhas
+	@param ncolumns Quantidade de colunas
+	@param nkeys Quantidade máxima de chaves para controle de acesso (1 a 254)
+	
+	O mapa registra as disputas de cada linha. Em um momento seguro, onde
+	nenhuma tarefa acessa o mapa, map2_unsafe_restripe(..) redistribui as
+	linhas entre as chaves equilibrando as disputas. Tarefas que obtêm a chave
+	com map2_key(..) não precisam ser alteradas
+	
+	Inicialmente as linhas são distribuídas como em MAP2_KEYMAP_MODULO()
+	
+	@note Disponível somente com MAP2_CONFIG_STATS definido
+	
+	@note A chave de uma linha pode mudar após o remapeamento, não armazene a
+	chave obtida com map2_key(..)
+	
+	Exemplo:
+		MAP2_ADAPTIVE(t_t, my_map4, SLOT_MAX * SLOT_CH, SLOT_DEVICES, 4);
+*/
+#define MAP2_ADAPTIVE(data_type, mapname, nrows, ncolumns, nkeys)	\
+	MAP2_ADAPTIVE_STRIPES(data_type, mapname, nrows, ncolumns, nkeys, nkeys)
+
+/**
+	@brief Macro para criação de mapa com remapeamento adaptativo de chaves,
+	iniciando com parte das chaves
+	
+	@param data_type Tipo de dado do mapa
+	@param mapname Nome do mapa
+	@param nrows Quantidade de linhas
+	@param ncolumns Quantidade de colunas
+	@param nkeys Quantidade máxima de chaves para controle de acesso (1 a 254)
+	@param nstripes Chaves utilizadas inicialmente (1 a 'nkeys')
+	
+	As linhas são distribuídas inicialmente entre 'nstripes' chaves (linha %
+	'nstripes'). Quando a disputa aumenta, map2_unsafe_restripe(..) pode
+	utilizar mais chaves, até 'nkeys', as chaves restantes ficam reservadas
+	para este crescimento
+	
+	Memória dos mutex: nkeys * sizeof(OS_MUT), mesmo antes do crescimento
+	
+	Exemplo:
+		MAP2_ADAPTIVE_STRIPES(t_t, my_map4, SLOT_MAX * SLOT_CH, SLOT_DEVICES, 8, 2);
+		...
+		map2_unsafe_restripe(&my_map4, 8);
+*/
+#ifdef MAP2_CONFIG_STATS
+#define MAP2_ADAPTIVE_STRIPES(data_type, mapname, nrows, ncolumns, nkeys, nstripes)	\
+	_Static_assert((nkeys) >= 1 && (nkeys) <= 254, "MAP2_ADAPTIVE: nkeys must be 1 to 254");	\
+	_Static_assert((nstripes) >= 1 && (nstripes) <= (nkeys), "MAP2_ADAPTIVE: nstripes must be 1 to nkeys");	\
+	static data_type __##mapname [nrows][ncolumns] MAP2_DATA_ATTR;	\
+	MAP2_OS_MUT_CREATE(mapname, nkeys)						\
+	MAP2_FAST_CREATE(mapname, nkeys)						\
+	MAP2_STATS_CREATE(mapname, nkeys)						\
+	MAP2_CHECK_CREATE(mapname, nkeys)						\
+	MAP2_SAMPLE_CREATE(mapname, nkeys)						\
+	MAP2_RECORD_CREATE(mapname, nkeys)						\
+	MAP2_STAMP_CREATE(mapname, nrows, ncolumns)				\
+	static uint8_t __##mapname##_table [nrows];				\
+	static uint32_t __##mapname##_hits [nrows];				\
+	static uint32_t __##mapname##_order [nrows];			\
+	static uint32_t __##mapname##_load [nkeys];				\
+	static map2_adapt_t __##mapname##_adapt = {				\
+		.table = __##mapname##_table,						\
+		.hits = __##mapname##_hits,							\
+		.order = __##mapname##_order,						\
+		.load = __##mapname##_load,							\
+	};														\
+	static map2_ready_t __##mapname##_ready;				\
+	map2_t mapname = { 										\
+		.data = __##mapname, 								\
+		.name = #mapname,									\
+		.type = #data_type,									\
+		.ready = &__##mapname##_ready,						\
+		.rows = nrows,										\
+		.columns = ncolumns,								\
+		.data_size = sizeof(__##mapname),					\
+		.field_size = sizeof(data_type),					\
+		.mut = MAP2_OS_MUT_REF(mapname),					\
+		.keys = nkeys,										\
+		.keymap = MAP2_KEYMAP_ADAPTIVE(__##mapname##_table, nstripes),	\
+		.stats = MAP2_STATS_REF(mapname),					\
+		.owner = MAP2_CHECK_REF(mapname),					\
+		.sample = MAP2_SAMPLE_REF(mapname),					\
+		.record = MAP2_RECORD_REF(mapname),					\
+		.stamp = MAP2_STAMP_REF(mapname),					\
+		.adapt = &__##mapname##_adapt,						\
+		.fast = MAP2_FAST_REF(mapname),						\
+	};
+#endif
+
+/**
+	@brief Macro para criação de mapa com histórico de valores por item
+	
+	@param data_type Tipo de dado do mapa
+	@param mapname Nome do mapa
+	@param nrows Quantidade de linhas
+	@param ncolumns Quantidade de colunas
+	@param nkeys Quantidade máxima de chaves para controle de acesso
+	@param hdepth Quantidade de valores guardados por item
+	
+	Cada escrita (map2_readwrite*, map2_write*, map2_scatter) grava o novo
+	valor do item no histórico ao liberar a chave. map2_history_append(..)
+	grava o valor atual explicitamente. O histórico é lido sem alocar a chave
+	com map2_history_read(..)
+	
+	MAP2_HISTORY_FIELD(..) grava apenas o campo 'member' do item, utilizado em
+	campos numéricos de itens grandes
+	
+	Cada posição guarda o valor completo, não a diferença para o valor
+	anterior, assim a memória não depende de quanto o valor varia:
+	
+	Memória: nrows * ncolumns * (4 + hdepth * (4 + valor alinhado a 4 bytes))
+	
+	Exemplo:
+		MAP2_HISTORY(t_t, my_map6, SLOT_MAX * SLOT_CH, SLOT_DEVICES, MAP2_NKEYS_3, 16);
+		MAP2_HISTORY_FIELD(t_t, my_map7, SLOT_MAX * SLOT_CH, SLOT_DEVICES, MAP2_NKEYS_3, 64, value);
+*/
+#define MAP2_HISTORY(data_type, mapname, nrows, ncolumns, nkeys, hdepth)	\
+	__MAP2_HISTORY(data_type, mapname, nrows, ncolumns, nkeys, hdepth, 0, 0, sizeof(data_type))
+
+#define MAP2_HISTORY_FIELD(data_type, mapname, nrows, ncolumns, nkeys, hdepth, member)	\
+	__MAP2_HISTORY(data_type, mapname, nrows, ncolumns, nkeys, hdepth,		\
+		offsetof(data_type, member), sizeof(((data_type*)0)->member), sizeof(((data_type*)0)->member))
+
+#define __MAP2_HISTORY(data_type, mapname, nrows, ncolumns, nkeys, hdepth, foffset, fsize, vsize)	\
+	static data_type __##mapname [nrows][ncolumns] MAP2_DATA_ATTR;	\
+	MAP2_OS_MUT_CREATE(mapname, nkeys)						\
+	MAP2_FAST_CREATE(mapname, nkeys)						\
+	MAP2_STATS_CREATE(mapname, nkeys)						\
+	MAP2_CHECK_CREATE(mapname, nkeys)						\
+	MAP2_SAMPLE_CREATE(mapname, nkeys)						\
+	MAP2_RECORD_CREATE(mapname, nkeys)						\
+	MAP2_STAMP_CREATE(mapname, nrows, ncolumns)				\
+	static uint32_t __##mapname##_hseq [(nrows) * (ncolumns)];	\
+	static uint32_t __##mapname##_hring [(nrows) * (ncolumns) * (hdepth) * (1 + ((vsize) + 3) / 4)];	\
+	static map2_history_t __##mapname##_history = {			\
+		.seq = __##mapname##_hseq,							\
+		.ring = __##mapname##_hring,						\
+		.depth = hdepth,									\
+		.words = 1 + ((vsize) + 3) / 4,						\
+		.field = { .offset = foffset, .size = fsize },		\
+	};														\
+	static map2_ready_t __##mapname##_ready;				\
+	map2_t mapname = { 										\
+		.data = __##mapname, 								\
+		.name = #mapname,									\
+		.type = #data_type,									\
+		.ready = &__##mapname##_ready,						\
+		.rows = nrows,										\
+		.columns = ncolumns,								\
+		.data_size = sizeof(__##mapname),					\
+		.field_size = sizeof(data_type),					\
+		.mut = MAP2_OS_MUT_REF(mapname),					\
+		.keys = nkeys,										\
+		.stats = MAP2_STATS_REF(mapname),					\
+		.owner = MAP2_CHECK_REF(mapname),					\
+		.sample = MAP2_SAMPLE_REF(mapname),					\
+		.record = MAP2_RECORD_REF(mapname),					\
+		.stamp = MAP2_STAMP_REF(mapname),					\
+		.history = &__##mapname##_history,					\
+		.fast = MAP2_FAST_REF(mapname),						\
+	};
+
+/**
+	@brief Macro para criação de mapa com estatísticas por janela de um campo
+	numérico
+	
+	@param data_type Tipo de dado do mapa
+	@param mapname Nome do mapa
+	@param nrows Quantidade de linhas
+	@param ncolumns Quantidade de colunas
+	@param nkeys Quantidade máxima de chaves para controle de acesso
+	@param member Campo numérico do item, convertido para int32_t
+	@param wticks Duração da janela em ticks, maior que 0
+	@param ema_shift Peso da média móvel exponencial, 1 / 2^ema_shift
+	
+	A cada escrita (mesmos pontos de MAP2_HISTORY) o mínimo, o máximo, a média
+	móvel e a quantidade de escritas do item são atualizados em O(1). A
+	leitura com map2_window_read(..) não aloca a chave
+	
+	Memória: nrows * ncolumns * sizeof(map2_window_cell_t)
+	
+	Exemplo:
+		MAP2_WINDOW(t_t, my_map8, SLOT_MAX * SLOT_CH, SLOT_DEVICES, MAP2_NKEYS_3, value, 1000, 3);
+*/
+#define MAP2_WINDOW(data_type, mapname, nrows, ncolumns, nkeys, member, wticks, ema_shift)	\
+	_Static_assert((wticks) > 0, "MAP2_WINDOW: wticks must be greater than 0");	\
+	static data_type __##mapname [nrows][ncolumns] MAP2_DATA_ATTR;	\
+	MAP2_OS_MUT_CREATE(mapname, nkeys)						\
+	MAP2_FAST_CREATE(mapname, nkeys)						\
+	MAP2_STATS_CREATE(mapname, nkeys)						\
+	MAP2_CHECK_CREATE(mapname, nkeys)						\
+	MAP2_SAMPLE_CREATE(mapname, nkeys)						\
+	MAP2_RECORD_CREATE(mapname, nkeys)						\
+	MAP2_STAMP_CREATE(mapname, nrows, ncolumns)				\
+	static int32_t __##mapname##_window_get(const void *item) {	\
+		return (int32_t)((const data_type*)item)->member;	\
+	}														\
+	static map2_window_cell_t __##mapname##_wcells [(nrows) * (ncolumns)];	\
+	static map2_window_t __##mapname##_window = {			\
+		.cells = __##mapname##_wcells,						\
+		.get = __##mapname##_window_get,					\
+		.window = wticks,									\
+		.shift = ema_shift,									\
+	};														\
+	static map2_ready_t __##mapname##_ready;				\
+	map2_t mapname = { 										\
+		.data = __##mapname, 								\
+		.name = #mapname,									\
+		.type = #data_type,									\
+		.ready = &__##mapname##_ready,						\
+		.rows = nrows,										\
+		.columns = ncolumns,								\
+		.data_size = sizeof(__##mapname),					\
+		.field_size = sizeof(data_type),					\
+		.mut = MAP2_OS_MUT_REF(mapname),					\
+		.keys = nkeys,										\
+		.stats = MAP2_STATS_REF(mapname),					\
+		.owner = MAP2_CHECK_REF(mapname),					\
+		.sample = MAP2_SAMPLE_REF(mapname),					\
+		.record = MAP2_RECORD_REF(mapname),					\
+		.stamp = MAP2_STAMP_REF(mapname),					\
+		.window = &__##mapname##_window,					\
+		.fast = MAP2_FAST_REF(mapname),						\
+	};
+
+/**
+	@brief Macro para criação de mapa com itens indiretos
+	
+	@param mapname Nome do mapa
+	@param nrows Quantidade de linhas
+	@param ncolumns Quantidade de colunas
+	@param nkeys Quantidade máxima de chaves para controle de acesso
+	@param bsize Tamanho máximo do conteúdo de um item, em bytes
+	@param nblocks Quantidade de blocos do pool (1 a 65535)
+	
+	Cada item guarda apenas o identificador de um bloco do pool, 0 quando
+	vazio. O escritor preenche um bloco novo e o troca no item, o leitor obtém
+	uma referência ao bloco sem copiar o conteúdo. A chave é alocada apenas
+	durante a troca ou a obtenção da referência
+	
+	Um bloco publicado não é mais alterado, leitores continuam com o conteúdo
+	antigo até liberarem a referência. Dimensione 'nblocks' pelos itens
+	ocupados mais os blocos retidos por leitores e escritores
+	
+	Os itens guardam identificadores de blocos, map2_readwrite*(..),
+	map2_write*(..) e map2_scatter(..) retornam erro neste mapa pois não
+	mantêm as referências. map2_unsafe_*(..) também não as mantêm
+	
+	Memória: nrows * ncolumns * sizeof(uint32_t) + nblocks * (bsize + 10)
+	
+	Exemplo:
+		MAP2_INDIRECT(frames, SLOT_MAX * SLOT_CH, 1, MAP2_NKEYS_3, 1536, 16);
+		
+		uint8_t *buf = map2_indirect_alloc(&frames);
+		if (buf != NULL) {
+			size_t n = uart_read(buf, 1536);
+			if (!map2_indirect_put(&frames, c, 0, map2_key(&frames, c), buf, n, 2000))
+				map2_indirect_release(&frames, buf);
+		}
+		
+		const uint8_t *frame;
+		uint32_t length;
+		map2_indirect_try(&frames, c, 0, map2_key(&frames, c), frame, length, 2000, {
+			send(frame, length);
+		});
+*/
+#define MAP2_INDIRECT(mapname, nrows, ncolumns, nkeys, bsize, nblocks)	\
+	static uint32_t __##mapname [nrows][ncolumns] MAP2_DATA_ATTR;	\
+	MAP2_OS_MUT_CREATE(mapname, nkeys)						\
+	MAP2_FAST_CREATE(mapname, nkeys)						\
+	MAP2_STATS_CREATE(mapname, nkeys)						\
+	MAP2_CHECK_CREATE(mapname, nkeys)						\
+	MAP2_SAMPLE_CREATE(mapname, nkeys)						\
+	MAP2_RECORD_CREATE(mapname, nkeys)						\
+	MAP2_STAMP_CREATE(mapname, nrows, ncolumns)				\
+	static uint8_t __##mapname##_blocks [nblocks][bsize] __attribute__((aligned(8)));	\
+	static uint32_t __##mapname##_ref [nblocks];			\
+	static uint32_t __##mapname##_length [nblocks];			\
+	static uint16_t __##mapname##_next [nblocks];			\
+	static map2_slab_t __##mapname##_slab = {				\
+		.blocks = &__##mapname##_blocks[0][0],				\
+		.ref = __##mapname##_ref,							\
+		.length = __##mapname##_length,						\
+		.next = __##mapname##_next,							\
+		.size = bsize,										\
+		.count = nblocks,									\
+	};														\
+	static map2_ready_t __##mapname##_ready;				\
+	map2_t mapname = { 										\
+		.data = __##mapname, 								\
+		.name = #mapname,									\
+		.type = "map2_indirect",							\
+		.ready = &__##mapname##_ready,						\
+		.rows = nrows,										\
+		.columns = ncolumns,								\
+		.data_size = sizeof(__##mapname),					\
+		.field_size = sizeof(uint32_t),						\
+		.mut = MAP2_OS_MUT_REF(mapname),					\
+		.keys = nkeys,										\
+		.stats = MAP2_STATS_REF(mapname),					\
+		.owner = MAP2_CHECK_REF(mapname),					\
+		.sample = MAP2_SAMPLE_REF(mapname),					\
+		.record = MAP2_RECORD_REF(mapname),					\
+		.stamp = MAP2_STAMP_REF(mapname),					\
+		.slab = &__##mapname##_slab,						\
+		.fast = MAP2_FAST_REF(mapname),						\
+	};
+
+/**
+	@brief Macro para importar mapas apenas pelo nome
+*/
+#define MAP2_IMPORT(mapname) \
+	extern map2_t mapname;
+
+void __map2_init(const map2_t *m);
+
+/**
+	@brief Inicialização básica do mapa
+	
+	@param m Endereço do mapa
+	@param fnc Função de inicialização
+	
+	Essa função inicializa apenas o mutex de controle de acesso ao mapa e
+	registra o mapa, ver map2_registry_count(..)
+	
+	A inicialização também ocorre no primeiro acesso ao mapa, assim a chamada
+	é opcional e não precisa ocorrer no boot. Chame map2_init(..) para que o
+	mapa conste no registro antes do primeiro acesso ou para executar 'fnc'
+	
+	@note O mutex é inicializado uma única vez, chamadas seguintes apenas
+	executam 'fnc'
+	Outros dados podem ser iniciados implementando 'func', por exemplo:
+		map2_init(&my_map1, {
+			map2_unsafe_foreach(&my_map1, item, t_t) {
+				item->a = 0;
+				item->b = 1;
+			}
+		});
+	Ou utilizando função de inicialização, por exemplo:
+		map2_init(&my_map1, my_map_init(&my_map1));
+*/
+#define map2_init(m, fnc) \
+	__map2_init(m); \
+	fnc;
+
+/**
+	@brief Laço para cada elemento de um mapa
+	
+	@param m Endereço do mapa
+	@param item Item (disponível apenas dentro do laço)
+	@param type Tipo de dados do mapa
+	
+	@note Não seguro! O controle de acesso não é utilizado
+*/
+#define map2_unsafe_foreach(m, item, type) \
+	for (type *item = (type*)(m)->data; item != NULL && item < map2_ptr((m)->data, (m)->data_size, type); item++)
+
+/**
+	@brief Retorna a posição da linha para um item no mapa
+	
+	@param m Endereço do mapa
+	@param item Item (disponível apenas dentro do laço)
+	@param type Tipo de dados do mapa
+	
+		map2_unsafe_foreach(&my_map1, item, t_t) {
+			int row = map2_item_row(&my_map1, item, t_t);
+		}
+	
+	@note Para ser usado com map2_unsafe_foreach()
+*/
+#define map2_item_row(m, item, type) \
+	((item - (type*)(m)->data) / (m)->columns)
+
+/**
+	@brief Retorna a posição da coluna para um item no mapa
+	
+	@param m Endereço do mapa
+	@param item Item (disponível apenas dentro do laço)
+	@param type Tipo de dados do mapa
+	
+		map2_unsafe_foreach(&my_map1, item, t_t) {
+			int column = map2_item_column(&my_map1, item, t_t);
+		}
+	
+	@note Para ser usado com map2_unsafe_foreach()
+*/
+#define map2_item_column(m, item, type) \
+	((item - (type*)(m)->data) % (m)->columns)
+
+int map2_key(const map2_t *m, int row);
+bool map2_keymap_check(const map2_t *m);
+bool map2_stats(const map2_t *m, int key, map2_stats_t *stats);
+void map2_stats_reset(const map2_t *m);
+void map2_hist_add(map2_hist_t *h, uint32_t v);
+uint32_t map2_hist_quantile(const map2_hist_t *h, uint32_t num, uint32_t den);
+bool map2_unsafe_restripe(const map2_t *m, int stripes);
+bool map2_adapt_report(const map2_t *m, map2_adapt_report_t *report);
+uint32_t map2_check_violations(void);
+int map2_registry_count(void);
+const map2_t *map2_registry_get(int index);
+const map2_t *map2_registry_find(const char *name);
+bool map2_info(const map2_t *m, map2_info_t *info);
+void map2_sample_config(uint32_t every, uint32_t wait);
+int map2_sample_read(uint32_t *cursor, map2_sample_t *samples, int max);
+void *__map2_take_age(const map2_t *m, int row, int column, int key, void *dst, uint32_t tout, uint32_t *age);
+bool map2_history_append(const map2_t *m, int row, int column, int key, uint32_t tout);
+int map2_history_read(const map2_t *m, int row, int column, uint32_t *stamps, void *values, int max);
+void map2_record_enable(bool enable);
+int map2_record_read(uint32_t *cursor, map2_record_t *records, int max);
+void __map2_drop(const map2_t *m, int row, int column, int key);
+void *__map2_take(const map2_t *m, int row, int column, int key, void *dst, uint32_t tout, map2_operation_t op);
+void __map2_drop_row(const map2_t *m, int row, int key);
+void *__map2_take_row(const map2_t *m, int row, int key, void *dst, size_t size, uint32_t tout, map2_operation_t op);
+bool __map2_put_row(const map2_t *m, int row, int key, const void *src, size_t size, uint32_t tout);
+int __map2_put_changed(const map2_t *m, int row, int column, int key, const void *src, size_t size, uint32_t tout);
+
+/**
+	@brief Acesso seguro para leitura de um item no mapa
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param dst Item (destido onde os dados do item serão copiados)
+	@param tout Timeout de acesso
+	@param fnc Função executada quando o item estiver disponível
+	@param err Função executada quando ocorrer erro no acesso
+	
+	Exemplo:
+		int key = map2_key(&my_map1, c);
+		t_t data_ro = {0};
+		map2_readonly_trycatch(&my_map1, c, n, key, data_ro, 2000, {
+			int a = data_ro.a;
+			int b = data_ro.b;
+		},{
+			...
+		});
+	
+	@note Para acessar todas as colunas de uma linha utilize
+	map2_readonly_row*(), o acesso é alocado uma única vez para a linha
+	
+	@note Mesmo que o item seja modificado dentro de 'func', seus dados não
+	serão replicados para o mapa
+	
+	@note O acesso ao mapa é requisitado ao chamar map2_readonly*() e liberado o
+	mais rápido possível, antes de executar o bloco de código implementado em
+	'fnc'
+	
+	@note Se o bloco de código 'err' for executado, o acesso ao mapa não foi
+	alocado
+*/
+#define map2_readonly_trycatch(m, row, column, key, dst, tout, fnc, err)	\
+	if (__map2_take(m, row, column, key, &dst, tout, MAP2_OP_READONLY) != NULL) { \
+		fnc; \
+	} else { \
+		err; \
+	}
+#define map2_readonly_try(m, row, column, key, dst, tout, fnc) \
+	map2_readonly_trycatch(m, row, column, key, dst, tout, fnc, {})
+
+/**
+	@brief Acesso seguro para leitura de um item do mapa, com a idade do item
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param dst Item (variável, não ponteiro)
+	@param age Variável uint32_t onde a idade do item será escrita, em ticks
+	desde a última escrita ou, MAP2_AGE_NEVER
+	@param tout Timeout de acesso
+	@param fnc Bloco executado quando o item foi lido
+	@param err Bloco executado quando ocorrer erro no acesso
+	
+	A idade é lida com a chave alocada, junto com a cópia do item
+	
+	Exemplo:
+		t_t item;
+		uint32_t age;
+		map2_readonly_age_try(&my_map1, c, 0, map2_key(&my_map1, c), item, age, 2000, {
+			if (age < 100)
+				...
+		});
+	
+	@note Requer MAP2_CONFIG_STAMP, sem ele 'age' é sempre MAP2_AGE_NEVER
+*/
+#define map2_readonly_age_trycatch(m, row, column, key, dst, age, tout, fnc, err) \
+	if (__map2_take_age(m, row, column, key, &dst, tout, &age) != NULL) { \
+		fnc; \
+	} else { \
+		err; \
+	}
+#define map2_readonly_age_try(m, row, column, key, dst, age, tout, fnc) \
+	map2_readonly_age_trycatch(m, row, column, key, dst, age, tout, fnc, {})
+
+#define map2_readonly_trycatch2(m, row, column, key, dst, tout, fnc, err)	\
+	t_t __map2_tmp_data = {0}; \
+	if (__map2_take(m, row, column, key, &__map2_tmp_data, tout, MAP2_OP_READONLY) != NULL) { \
+		dst = (const t_t*)&__map2_tmp_data; \
+		fnc; \
+	} else { \
+		err; \
+	}
+
+/**
+	@brief Acesso seguro para escrita/leitura de um item no mapa
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param dst Ponteiro para item (acesso direto ao mapa)
+	@param tout Timeout de acesso
+	@param fnc Função executada quando o item estiver disponível
+	@param err Função executada quando ocorrer erro no acesso
+	
+	Exemplo:
+		int key = map2_key(&my_map1, c);
+		t_t *data_rw;
+		map2_readwrite_trycatch(&my_map1, c, n, key, data_rw, 2000, {
+			data_rw->a *= 10;
+			data_rw->b *= 10;
+		},{
+			...
+		});
+	
+	@note Para alterar todas as colunas de uma linha utilize
+	map2_readwrite_row*() ou map2_write_row(), o acesso é alocado uma única vez
+	para a linha
+	
+	@note O item é um ponteiro para o mapa
+	
+	@note O acesso ao mapa é requisitado ao chamar map2_readwrite*() e liberado
+	após executar o bloco de código implementado em 'fnc'
+	
+	@note Se o bloco de código 'err' for executado, o acesso ao mapa não foi
+	alocado
+*/
+#define map2_readwrite_trycatch(m, row, column, key, dst, tout, fnc, err) \
+	if ((dst = __map2_take(m, row, column, key, dst, tout, MAP2_OP_READWRITE)) != NULL) { \
+		fnc; \
+		__map2_drop(m, row, column, key); \
+	} else { \
+		err; \
+	}
+#define map2_readwrite_try(m, row, column, key, dst, tout, fnc) \
+	map2_readwrite_trycatch(m, row, column, key, dst, tout, fnc, {})
+
+/**
+	@brief Acesso seguro para leitura de todas as colunas de uma linha do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição da linha
+	@param key Poisição da chave de acesso
+	@param dst Vetor com uma posição para cada coluna (destino onde os dados da
+	linha serão copiados)
+	@param tout Timeout de acesso
+	@param fnc Função executada quando a linha estiver disponível
+	@param err Função executada quando ocorrer erro no acesso
+	
+	Exemplo:
+		for (int c = 0; c < 3; c++) {
+			int key = map2_key(&my_map1, c);
+			t_t row_ro[SLOT_DEVICES];
+			map2_readonly_row_trycatch(&my_map1, c, key, row_ro, 2000, {
+				for (int n = 0; n < SLOT_DEVICES; n++) {
+					int a = row_ro[n].a;
+				}
+			},{
+				break;
+			});
+		}
+	
+	@note O tamanho de 'dst' é obtido com sizeof(dst) e deve ser igual ao
+	tamanho da linha, caso contrário 'err' é executado
+	
+	@note O acesso é alocado uma única vez para toda a linha e liberado logo
+	após a cópia, antes de executar 'fnc'
+*/
+#define map2_readonly_row_trycatch(m, row, key, dst, tout, fnc, err) \
+	if (__map2_take_row(m, row, key, &dst, sizeof(dst), tout, MAP2_OP_READONLY) != NULL) { \
+		fnc; \
+	} else { \
+		err; \
+	}
+#define map2_readonly_row_try(m, row, key, dst, tout, fnc) \
+	map2_readonly_row_trycatch(m, row, key, dst, tout, fnc, {})
+
+/**
+	@brief Acesso seguro para escrita/leitura de todas as colunas de uma linha
+	do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição da linha
+	@param key Poisição da chave de acesso
+	@param dst Ponteiro para a primeira coluna da linha (acesso direto ao mapa)
+	@param tout Timeout de acesso
+	@param fnc Função executada quando a linha estiver disponível
+	@param err Função executada quando ocorrer erro no acesso
+	
+	Exemplo:
+		for (int c = 0; c < 3; c++) {
+			int key = map2_key(&my_map1, c);
+			t_t *row_rw;
+			map2_readwrite_row_trycatch(&my_map1, c, key, row_rw, 2000, {
+				for (int n = 0; n < SLOT_DEVICES; n++) {
+					row_rw[n].a *= 10;
+					row_rw[n].b *= 10;
+				}
+			},{
+				break;
+			});
+		}
+	
+	@note O acesso é alocado uma única vez para toda a linha e liberado após
+	executar 'fnc'
+*/
+#define map2_readwrite_row_trycatch(m, row, key, dst, tout, fnc, err) \
+	if ((dst = __map2_take_row(m, row, key, NULL, 0, tout, MAP2_OP_READWRITE)) != NULL) { \
+		fnc; \
+		__map2_drop_row(m, row, key); \
+	} else { \
+		err; \
+	}
+#define map2_readwrite_row_try(m, row, key, dst, tout, fnc) \
+	map2_readwrite_row_trycatch(m, row, key, dst, tout, fnc, {})
+
+/**
+	@brief Substitui todas as colunas de uma linha do mapa
+	
+	@param m Endereço do mapa
+	@param row Posição da linha
+	@param key Poisição da chave de acesso
+	@param src Vetor com uma posição para cada coluna
+	@param tout Timeout de acesso
+	
+	@return true quando a linha foi substituída
+	
+	Exemplo:
+		t_t row_new[SLOT_DEVICES] = {0};
+		map2_write_row(&my_map1, c, map2_key(&my_map1, c), row_new, 2000);
+	
+	@note O tamanho de 'src' é obtido com sizeof(src) e deve ser igual ao
+	tamanho da linha
+*/
+#define map2_write_row(m, row, key, src, tout) \
+	__map2_put_row(m, row, key, &src, sizeof(src), tout)
+
+/**
+	@brief Escreve um item do mapa somente quando o valor é diferente
+	
+	@param m Endereço do mapa
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param src Novo valor do item (variável, não ponteiro)
+	@param tout Timeout de acesso
+	
+	@return 1 quando o item foi alterado, 0 quando o valor era o mesmo ou, -1
+	quando ocorrer erro no acesso
+	
+	Escritores que repetem o mesmo valor não sujam a linha de cache do item,
+	evitando invalidar a cache das tarefas que o leem
+	
+	Exemplo:
+		t_t item = {.status = 1};
+		if (map2_write_changed(&my_map1, c, 0, map2_key(&my_map1, c), item, 2000) > 0) {
+			...
+		}
+	
+	@note O tamanho de 'src' é obtido com sizeof(src) e deve ser igual ao
+	tamanho do item
+*/
+#define map2_write_changed(m, row, column, key, src, tout) \
+	__map2_put_changed(m, row, column, key, &src, sizeof(src), tout)
+
+/**
+	Posição de um item no mapa, utilizado em map2_gather(..) e map2_scatter(..)
+*/
+typedef struct {
+	int row;				/** Posição do item na linha */
+	int column;				/** Posição do item na coluna */
+}
+map2_cell_t;
+
+int map2_gather(const map2_t *m, const map2_cell_t *cells, int n, void *dst, uint32_t tout);
+int map2_scatter(const map2_t *m, const map2_cell_t *cells, int n, const void *src, uint32_t tout);
+
+size_t map2_project(const map2_t *m, int row, int column, int key, const map2_field_t *fields, int n, void *dst, uint32_t tout);
+uint32_t map2_age(const map2_t *m, int row, int column);
+bool map2_window_read(const map2_t *m, int row, int column, map2_window_stats_t *stats);
+int map2_stale(const map2_t *m, uint32_t window, map2_cell_t *cells, int max);
+
+void *map2_indirect_alloc(const map2_t *m);
+void map2_indirect_release(const map2_t *m, const void *buf);
+bool map2_indirect_put(const map2_t *m, int row, int column, int key, void *buf, uint32_t length, uint32_t tout);
+const void *map2_indirect_get(const map2_t *m, int row, int column, int key, uint32_t *length, uint32_t tout);
+
+/**
+	@brief Acesso sem cópia a um item indireto
+	
+	@param m Endereço do mapa, criado com MAP2_INDIRECT(..)
+	@param row Posição do item na linha
+	@param column Posição do item na coluna
+	@param key Poisição da chave de acesso
+	@param ptr Ponteiro constante que recebe o conteúdo do item
+	@param length Variável que recebe o tamanho do conteúdo
+	@param tout Timeout de acesso
+	@param fnc Função executada quando o item possui conteúdo
+	
+	A referência ao bloco é liberada ao final de 'fnc', a chave já foi
+	liberada antes de 'fnc' executar
+	
+	@note Não utilize break, continue ou return dentro de 'fnc'
+*/
+#define map2_indirect_try(m, row, column, key, ptr, length, tout, fnc) \
+	if (((ptr) = map2_indirect_get(m, row, column, key, &(length), tout)) != NULL) { \
+		fnc; \
+		map2_indirect_release(m, ptr); \
+	}
+
+/**
+	Tipo de dados correspondente ao mapa compactado
+	Cada item ocupa 'bits' bits de uma palavra de 32 bits, um item nunca é
+	dividido entre duas palavras
+	
+	@note Não crie manualmente, utilize MAP2_PACKED(..)
+*/
+typedef struct {
+	uint32_t *const data;	/** Ponteiro para as palavras do mapa */
+	const int rows;			/** Número de linhas */
+	const int columns;		/** Número de colunas */
+	const int bits;			/** Bits de um item */
+	const size_t data_size;	/** Tamanho total do mapa */
+}
+map2_packed_t;
+
+/**
+	Campo de um item do mapa compactado
+	
+	@note Utilize MAP2_BITFIELD(..)
+*/
+typedef struct {
+	uint8_t shift;			/** Posição do primeiro bit no item */
+	uint8_t width;			/** Quantidade de bits */
+}
+map2_bitfield_t;
+
+/**
+	@brief Declaração de campo de um item do mapa compactado
+	
+	@param shift Posição do primeiro bit no item
+	@param width Quantidade de bits
+	
+	Exemplo:
+		#define ST_ONLINE	MAP2_BITFIELD(0, 1)
+		#define ST_ALARM	MAP2_BITFIELD(1, 1)
+		#define ST_MODE		MAP2_BITFIELD(2, 3)
+*/
+#define MAP2_BITFIELD(shift, width)	((map2_bitfield_t){ (shift), (width) })
+
+/**
+	@def MAP2_PACKED_WORDS Quantidade de palavras de 32 bits do mapa compactado
+*/
+#define MAP2_PACKED_WORDS(nrows, ncolumns, nbits) \
+	(((nrows) * (ncolumns) + (32 / (nbits)) - 1) / (32 / (nbits)))
+
+/**
+	@brief Macro para criação de mapa compactado
+	
+	@param mapname Nome do mapa
+	@param nrows Quantidade de linhas
+	@param ncolumns Quantidade de colunas
+	@param nbits Bits de um item (1 a 32)
+	
+	Os campos são lidos e alterados com operações atômicas, sem utilizar mutex,
+	logo não há chave de acesso
+	
+	Exemplo:
+		MAP2_PACKED(my_flags, SLOT_MAX * SLOT_CH, SLOT_DEVICES, 5);
+		
+		map2_packed_set(&my_flags, c, n, ST_MODE, 3);
+		map2_packed_flag(&my_flags, c, n, ST_ALARM, true);
+		if (map2_packed_get(&my_flags, c, n, ST_ONLINE)) {
+			...
+		}
+*/
+#define MAP2_PACKED(mapname, nrows, ncolumns, nbits)			\
+	static uint32_t __##mapname [MAP2_PACKED_WORDS(nrows, ncolumns, nbits)];	\
+	map2_packed_t mapname = {								\
+		.data = __##mapname,								\
+		.rows = nrows,										\
+		.columns = ncolumns,								\
+		.bits = nbits,										\
+		.data_size = sizeof(__##mapname),					\
+	};
+
+/**
+	@brief Macro para importar mapas compactados apenas pelo nome
+*/
+#define MAP2_PACKED_IMPORT(mapname) \
+	extern map2_packed_t mapname;
+
+uint32_t map2_packed_get(const map2_packed_t *m, int row, int column, map2_bitfield_t f);
+bool map2_packed_set(const map2_packed_t *m, int row, int column, map2_bitfield_t f, uint32_t value);
+bool map2_packed_cas(const map2_packed_t *m, int row, int column, map2_bitfield_t f, uint32_t expected, uint32_t value);
+bool map2_packed_flag(const map2_packed_t *m, int row, int column, map2_bitfield_t f, bool on);
+
+#endif
@@ -0,0 +1,1050 @@
+#define _GNU_SOURCE
+#include "map2_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define DBG_MODULE "map2_host"
+#include "shared/dbg.h"
+
+/**
+	Definições da política NUMA (linux/mempolicy.h), evitando dependência
+	da libnuma
+*/
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED		1
+#endif
+#ifndef MPOL_BIND
+#define MPOL_BIND			2
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE		(1 << 1)
+#endif
+
+/**
+	@def MAP2_HOST_HUGEPAGE_DEFAULT Tamanho da página grande quando não for
+	possível consultar o sistema
+*/
+#define MAP2_HOST_HUGEPAGE_DEFAULT	(2 * 1024 * 1024)
+
+/**
+	@def MAP2_HOST_TIMESTAMP_SCALE Conversão de MAP2_TIMESTAMP() para segundos
+	nos histogramas exportados por map2_host_metrics(..)
+*/
+#ifndef MAP2_HOST_TIMESTAMP_SCALE
+#define MAP2_HOST_TIMESTAMP_SCALE	(1e-9)
+#endif
+
+#define __map2_host_align_down(v, a)	((uintptr_t)(v) & ~((uintptr_t)(a) - 1))
+#define __map2_host_align_up(v, a)	__map2_host_align_down((uintptr_t)(v) + (a) - 1, (a))
+
+/**
+	@brief Tamanho da página grande do sistema
+	
+	@return Tamanho em bytes
+*/
+static size_t __map2_host_hugepage_size(void) {
+	size_t size = 0;
+	char line[128];
+	FILE *f = fopen("/proc/meminfo", "r");
+	
+	MAP2_ASSERT(f == NULL, return MAP2_HOST_HUGEPAGE_DEFAULT);
+	
+	while (size == 0 && fgets(line, sizeof(line), f) != NULL) {
+		unsigned long kb;
+		if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1)
+			size = (size_t)kb * 1024;
+	}
+	
+	fclose(f);
+	return size != 0 ? size : MAP2_HOST_HUGEPAGE_DEFAULT;
+}
+
+/**
+	@brief Utiliza páginas grandes para os dados do mapa
+	
+	@param m Endereço do mapa
+	@param mode Modo de página
+	
+	@return true quando ao menos uma página grande foi configurada
+	
+	Apenas as páginas grandes inteiramente contidas nos dados do mapa são
+	alteradas, o início e o final fora do alinhamento permanecem em páginas
+	normais. Utilize MAP2_CONFIG_HOST_HUGEPAGE para alinhar os dados do mapa.
+	
+	No modo MAP2_HOST_PAGE_EXPLICIT os dados são copiados para uma região
+	hugetlbfs, que em seguida é movida para o endereço original do mapa, assim
+	o conteúdo do mapa é preservado. Mover uma região hugetlbfs com
+	mremap(MREMAP_FIXED) requer um kernel recente. Quando não há páginas
+	reservadas ou o mremap falha a falha é registrada (DBG_ENABLE) e o modo
+	MAP2_HOST_PAGE_THP é utilizado.
+	
+	Exemplo:
+		map2_init(&my_map1, {
+			map2_host_hugepage(&my_map1, MAP2_HOST_PAGE_EXPLICIT);
+			map2_host_numa_bind(&my_map1, 2, 1, MAP2_HOST_NUMA_PREFERRED);
+		});
+	
+	@note Não seguro! Deve ser utilizado na inicialização, antes que outras
+	tarefas acessem o mapa
+*/
+bool map2_host_hugepage(const map2_t *m, map2_host_page_t mode) {
+	MAP2_ASSERT(m == NULL || m->data == NULL, return false);
+	
+	size_t hp = __map2_host_hugepage_size();
+	uintptr_t start = __map2_host_align_up(m->data, hp);
+	uintptr_t end = __map2_host_align_down((uintptr_t)m->data + m->data_size, hp);
+	
+	MAP2_ASSERT(end <= start, return false);
+	
+	void *addr = (void*)start;
+	size_t len = end - start;
+	
+	if (mode == MAP2_HOST_PAGE_EXPLICIT) {
+		void *tmp = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		
+		if (tmp == MAP_FAILED) {
+			dbgW("Hugetlb mmap failed len:%zu: %s, using THP\n", len, strerror(errno));
+		}
+		else {
+			memcpy(tmp, addr, len);
+			
+			if (mremap(tmp, len, len, MREMAP_MAYMOVE | MREMAP_FIXED, addr) != MAP_FAILED)
+				return true;
+			
+			dbgW("Hugetlb mremap failed len:%zu: %s, using THP\n", len, strerror(errno));
+			
+			// Kernels sem mremap de regiões hugetlbfs liberam o destino antes
+			// de falhar, a região original é recriada com a cópia dos dados
+			bool restored = mmap(addr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == addr;
+			
+			if (restored)
+				memcpy(addr, tmp, len);
+			munmap(tmp, len);
+			
+			MAP2_ASSERT(!restored, return false);
+		}
+	}
+	
+	return madvise(addr, len, MADV_HUGEPAGE) == 0;
+}
+
+/**
+	@brief Aloca as linhas de uma chave de acesso em um nó NUMA
+	
+	@param m Endereço do mapa
+	@param key Posição da chave de acesso
+	@param node Nó NUMA das tarefas que utilizam a chave
+	@param policy Política de alocação
+	
+	@return Quantidade de bytes alocados no nó
+	
+	As linhas pertencentes à chave são obtidas com map2_key(..). Somente as
+	páginas em que todas as linhas pertencem à chave são alocadas no nó, páginas
+	compartilhadas com outras chaves permanecem onde estão.
+	Páginas já utilizadas são migradas para o nó.
+	
+	@note Com MAP2_NKEYS_2 as linhas pares e ímpares são intercaladas, logo
+	apenas linhas maiores que uma página poderão ser separadas
+*/
+size_t map2_host_numa_bind(const map2_t *m, int key, int node, map2_host_numa_t policy) {
+	MAP2_ASSERT(m == NULL || m->data == NULL, return 0);
+	MAP2_ASSERT(key < 0 || key >= m->keys, return 0);
+	MAP2_ASSERT(node < 0 || node >= (int)(sizeof(unsigned long) * 8), return 0);
+	
+	unsigned long mask = 1UL << node;
+	int mode = policy == MAP2_HOST_NUMA_BIND ? MPOL_BIND : MPOL_PREFERRED;
+	size_t psz = (size_t)sysconf(_SC_PAGESIZE);
+	size_t row_size = (size_t)m->columns * m->field_size;
+	uintptr_t base = (uintptr_t)m->data;
+	uintptr_t end = __map2_host_align_down(base + m->data_size, psz);
+	uintptr_t run = 0;
+	size_t bound = 0;
+	
+	for (uintptr_t page = __map2_host_align_up(base, psz); page <= end; page += psz) {
+		bool own = page < end;
+		
+		for (size_t r = (page - base) / row_size; own && r <= (page + psz - 1 - base) / row_size; r++)
+			own = map2_key(m, (int)r) == key;
+		
+		if (own && run == 0)
+			run = page;
+		
+		if (!own && run != 0) {
+			if (syscall(SYS_mbind, run, page - run, mode, &mask, sizeof(mask) * 8, MPOL_MF_MOVE) == 0)
+				bound += page - run;
+			else
+				dbgW("Mbind failed key:%d node:%d len:%zu\n", key, node, (size_t)(page - run));
+			run = 0;
+		}
+	}
+	
+	return bound;
+}
+
+/**
+	@brief Ordena locais de chamada pelo tempo total aguardando, decrescente
+*/
+static int __map2_host_site_cmp(const void *a, const void *b) {
+	const map2_host_site_t *sa = a;
+	const map2_host_site_t *sb = b;
+	
+	return sa->wait_total < sb->wait_total ? 1 : sa->wait_total > sb->wait_total ? -1 : 0;
+}
+
+/**
+	@brief Agrupa amostras de acesso por local de chamada
+	
+	@param samples Amostras lidas com map2_sample_read(..)
+	@param n Quantidade de amostras
+	@param sites Destino dos locais de chamada
+	@param max Quantidade máxima de locais de chamada
+	
+	@return Quantidade de locais de chamada, ordenados pelo tempo total
+	aguardando a chave (piores primeiro)
+	
+	Exemplo:
+		map2_host_site_t sites[16];
+		char name[128];
+		int n = map2_host_sample_sites(s, count, sites, 16);
+		for (int i = 0; i < n; i++)
+			printf("%s %u %llu\n", map2_host_site_name(sites[i].site, name, sizeof(name)),
+				sites[i].count, sites[i].wait_total);
+	
+	@note Amostras de locais além de 'max' são descartadas
+*/
+int map2_host_sample_sites(const map2_sample_t *samples, int n, map2_host_site_t *sites, int max) {
+	MAP2_ASSERT(samples == NULL || sites == NULL || n < 0 || max <= 0, return 0);
+	
+	int count = 0;
+	
+	for (int i = 0; i < n; i++) {
+		const map2_sample_t *s = &samples[i];
+		int j = 0;
+		
+		while (j < count && sites[j].site != s->site)
+			j++;
+		
+		if (j == count) {
+			if (count == max)
+				continue;
+			memset(&sites[count], 0, sizeof(sites[count]));
+			sites[count++].site = s->site;
+		}
+		
+		sites[j].count++;
+		sites[j].wait_total += s->wait;
+		sites[j].hold_total += s->hold;
+		if (s->wait > sites[j].wait_max)
+			sites[j].wait_max = s->wait;
+		if (s->hold > sites[j].hold_max)
+			sites[j].hold_max = s->hold;
+	}
+	
+	qsort(sites, (size_t)count, sizeof(*sites), __map2_host_site_cmp);
+	
+	return count;
+}
+
+/**
+	@brief Nome de um local de chamada, no formato 'função+deslocamento'
+	
+	@param site Endereço do local de chamada
+	@param buf Destino do nome
+	@param len Tamanho de 'buf'
+	
+	@return 'buf'
+	
+	@note Utiliza os símbolos dinâmicos do executável, compile com -rdynamic.
+	Sem símbolo o endereço é utilizado
+*/
+const char *map2_host_site_name(uintptr_t site, char *buf, size_t len) {
+	MAP2_ASSERT(buf == NULL || len == 0, return NULL);
+	
+	Dl_info info;
+	
+	if (dladdr((void*)site, &info) != 0 && info.dli_sname != NULL)
+		snprintf(buf, len, "%s+0x%lx", info.dli_sname, (unsigned long)(site - (uintptr_t)info.dli_saddr));
+	else
+		snprintf(buf, len, "0x%lx", (unsigned long)site);
+	
+	return buf;
+}
+
+/**
+	Texto de saída de map2_host_metrics(..), 'pos' continua contando após
+	o final de 'buf' para informar o tamanho necessário
+*/
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t pos;
+}
+map2_host_text_t;
+
+/**
+	@brief Adiciona texto formatado à saída
+*/
+__attribute__((format(printf, 2, 3)))
+static void __map2_host_printf(map2_host_text_t *t, const char *fmt, ...) {
+	va_list ap;
+	size_t free = t->pos < t->len ? t->len - t->pos : 0;
+	
+	va_start(ap, fmt);
+	int n = vsnprintf(free != 0 ? t->buf + t->pos : NULL, free, fmt, ap);
+	va_end(ap);
+	
+	if (n > 0)
+		t->pos += (size_t)n;
+}
+
+/**
+	@brief Adiciona um valor de rótulo, com os caracteres especiais escapados
+*/
+static void __map2_host_label(map2_host_text_t *t, const char *name, const char *value) {
+	__map2_host_printf(t, "%s=\"", name);
+	
+	for (const char *c = value != NULL ? value : ""; *c != '\0'; c++) {
+		if (*c == '\\' || *c == '"')
+			__map2_host_printf(t, "\\%c", *c);
+		else if (*c == '\n')
+			__map2_host_printf(t, "\\n");
+		else
+			__map2_host_printf(t, "%c", *c);
+	}
+	
+	__map2_host_printf(t, "\"");
+}
+
+/**
+	@brief Adiciona o nome e os rótulos de uma amostra
+	
+	@param le Limite da posição do histograma ou, NULL
+*/
+static void __map2_host_series(map2_host_text_t *t, const char *metric, const char *suffix, const map2_info_t *info, const char *le) {
+	__map2_host_printf(t, "%s%s{", metric, suffix);
+	__map2_host_label(t, "map", info->name);
+	__map2_host_printf(t, ",");
+	__map2_host_label(t, "type", info->type);
+	if (le != NULL)
+		__map2_host_printf(t, ",le=\"%s\"", le);
+	__map2_host_printf(t, "} ");
+}
+
+/**
+	@brief Adiciona o cabeçalho de uma métrica
+*/
+static void __map2_host_family(map2_host_text_t *t, const char *metric, const char *type, const char *help) {
+	__map2_host_printf(t, "# HELP %s %s\n# TYPE %s %s\n", metric, help, metric, type);
+}
+
+#ifdef MAP2_CONFIG_STATS_HIST
+/**
+	@brief Adiciona um histograma de latência
+	
+	As posições do histograma são agrupadas por potência de 2, o valor de
+	'_sum' é estimado pelo centro de cada posição
+*/
+static void __map2_host_hist(map2_host_text_t *t, const char *metric, const map2_info_t *info, const map2_hist_t *h) {
+	const int sub = MAP2_CONFIG_HIST_SUB;
+	const int groups = 33 - sub;
+	uint64_t count = 0;
+	double sum = 0;
+	char le[32];
+	
+	for (int g = 0; g < groups; g++) {
+		for (int i = g << sub; i < (g + 1) << sub; i++) {
+			double mid = i;
+			
+			if (i >= (1 << sub)) {
+				int e = (i >> sub) + sub - 1;
+				uint64_t low = (uint64_t)((1 << sub) + (i & ((1 << sub) - 1))) << (e - sub);
+				mid = (double)low + (double)(((uint64_t)1 << (e - sub)) - 1) / 2;
+			}
+			
+			count += h->count[i];
+			sum += mid * h->count[i];
+		}
+		
+		if (g < groups - 1)
+			snprintf(le, sizeof(le), "%.9g", (double)(((uint64_t)1 << (g + sub)) - 1) * MAP2_HOST_TIMESTAMP_SCALE);
+		else
+			snprintf(le, sizeof(le), "+Inf");
+		
+		__map2_host_series(t, metric, "_bucket", info, le);
+		__map2_host_printf(t, "%llu\n", (unsigned long long)count);
+	}
+	
+	__map2_host_series(t, metric, "_sum", info, NULL);
+	__map2_host_printf(t, "%.9g\n", sum * MAP2_HOST_TIMESTAMP_SCALE);
+	__map2_host_series(t, metric, "_count", info, NULL);
+	__map2_host_printf(t, "%llu\n", (unsigned long long)count);
+}
+#endif
+
+/**
+	Contadores de map2_stats_t exportados
+*/
+typedef enum {
+	MAP2_HOST_METRIC_ACQUISITIONS = 0,
+	MAP2_HOST_METRIC_CONTENDED,
+	MAP2_HOST_METRIC_TIMEOUTS,
+#ifdef MAP2_CONFIG_STATS_HIST
+	MAP2_HOST_METRIC_LATE,
+	MAP2_HOST_METRIC_WAIT,
+	MAP2_HOST_METRIC_HOLD,
+#endif
+	MAP2_HOST_METRIC_COUNT,
+}
+map2_host_metric_t;
+
+static const struct {
+	const char *name;
+	const char *type;
+	const char *help;
+}
+map2_host_metrics_desc[MAP2_HOST_METRIC_COUNT] = {
+	[MAP2_HOST_METRIC_ACQUISITIONS] = {"map2_acquisitions_total", "counter", "Accesses granted"},
+	[MAP2_HOST_METRIC_CONTENDED] = {"map2_contended_total", "counter", "Accesses that waited for the key"},
+	[MAP2_HOST_METRIC_TIMEOUTS] = {"map2_timeouts_total", "counter", "Accesses not granted (timeout)"},
+#ifdef MAP2_CONFIG_STATS_HIST
+	[MAP2_HOST_METRIC_LATE] = {"map2_late_total", "counter", "Accesses that waited longer than the deadline"},
+	[MAP2_HOST_METRIC_WAIT] = {"map2_wait_seconds", "histogram", "Time waiting for the key"},
+	[MAP2_HOST_METRIC_HOLD] = {"map2_hold_seconds", "histogram", "Time holding the key"},
+#endif
+};
+
+/**
+	@brief Exporta as estatísticas dos mapas registrados no formato texto do
+	Prometheus
+	
+	@param buf Destino do texto, terminado em '\0'
+	@param len Tamanho de 'buf'
+	
+	@return Tamanho do texto completo, sem o '\0'. Quando maior ou igual a
+	'len' o texto foi truncado e deve ser gerado novamente com um 'buf' maior
+	
+	Para cada mapa registrado (ver map2_registry_count(..)) são exportados a
+	configuração (map2_map_info), a memória utilizada (map2_memory_bytes) e,
+	quando o mapa possui estatísticas, os contadores de acesso e os
+	histogramas de latência (MAP2_CONFIG_STATS_HIST).
+	
+	Exemplo:
+		static char text[64 * 1024];
+		size_t n = map2_host_metrics(text, sizeof(text));
+		if (n < sizeof(text))
+			send(fd, text, n, 0);
+	
+	@note Não aloca memória. As estatísticas são lidas sem alocar as chaves,
+	uma vez para cada métrica
+*/
+size_t map2_host_metrics(char *buf, size_t len) {
+	MAP2_ASSERT(buf == NULL && len != 0, return 0);
+	
+	map2_host_text_t t = {.buf = buf, .len = len, .pos = 0};
+	static const char *const lock[] = {"none", "mutex", "cell", "fast"};
+	map2_info_t info;
+	map2_stats_t stats;
+	
+	if (len != 0)
+		buf[0] = '\0';
+	
+	__map2_host_family(&t, "map2_map_info", "gauge", "Map configuration");
+	for (int i = 0; i < map2_registry_count(); i++) {
+		if (!map2_info(map2_registry_get(i), &info))
+			continue;
+		__map2_host_printf(&t, "map2_map_info{");
+		__map2_host_label(&t, "map", info.name);
+		__map2_host_printf(&t, ",");
+		__map2_host_label(&t, "type", info.type);
+		__map2_host_printf(&t, ",lock=\"%s\",rows=\"%d\",columns=\"%d\",keys=\"%d\",field_size=\"%zu\"} 1\n",
+			lock[info.lock], info.rows, info.columns, info.keys, info.field_size);
+	}
+	
+	__map2_host_family(&t, "map2_memory_bytes", "gauge", "Memory used by data, locks and optional structures");
+	for (int i = 0; i < map2_registry_count(); i++) {
+		if (!map2_info(map2_registry_get(i), &info))
+			continue;
+		__map2_host_series(&t, "map2_memory_bytes", "", &info, NULL);
+		__map2_host_printf(&t, "%zu\n", info.footprint);
+	}
+	
+	for (int f = 0; f < MAP2_HOST_METRIC_COUNT; f++) {
+		const char *metric = map2_host_metrics_desc[f].name;
+		
+		__map2_host_family(&t, metric, map2_host_metrics_desc[f].type, map2_host_metrics_desc[f].help);
+		
+		for (int i = 0; i < map2_registry_count(); i++) {
+			const map2_t *m = map2_registry_get(i);
+			
+			if (!map2_info(m, &info) || !info.stats || !map2_stats(m, -1, &stats))
+				continue;
+			
+			switch ((map2_host_metric_t)f) {
+				case MAP2_HOST_METRIC_ACQUISITIONS:
+					__map2_host_series(&t, metric, "", &info, NULL);
+					__map2_host_printf(&t, "%u\n", stats.acquisitions);
+					break;
+				case MAP2_HOST_METRIC_CONTENDED:
+					__map2_host_series(&t, metric, "", &info, NULL);
+					__map2_host_printf(&t, "%u\n", stats.contended);
+					break;
+				case MAP2_HOST_METRIC_TIMEOUTS:
+					__map2_host_series(&t, metric, "", &info, NULL);
+					__map2_host_printf(&t, "%u\n", stats.timeouts);
+					break;
+				#ifdef MAP2_CONFIG_STATS_HIST
+				case MAP2_HOST_METRIC_LATE:
+					__map2_host_series(&t, metric, "", &info, NULL);
+					__map2_host_printf(&t, "%u\n", stats.late);
+					break;
+				case MAP2_HOST_METRIC_WAIT:
+					__map2_host_hist(&t, metric, &info, &stats.wait);
+					break;
+				case MAP2_HOST_METRIC_HOLD:
+					__map2_host_hist(&t, metric, &info, &stats.hold);
+					break;
+				#endif
+				default:
+					break;
+			}
+		}
+	}
+	
+	return t.pos;
+}
+
+/**
+	Configuração perf_event de cada contador, na ordem de map2_host_perf_event_t
+*/
+static const struct {
+	uint32_t type;
+	uint64_t config;
+	const char *name;
+}
+map2_host_perf_desc[MAP2_HOST_PERF_COUNT] = {
+	[MAP2_HOST_PERF_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+	[MAP2_HOST_PERF_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+	[MAP2_HOST_PERF_L1D_MISSES] = {PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "l1d-misses"},
+	[MAP2_HOST_PERF_LLC_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "llc-misses"},
+	[MAP2_HOST_PERF_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch-misses"},
+	[MAP2_HOST_PERF_CONTEXT_SWITCHES] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context-switches"},
+};
+
+/**
+	@brief Abre os contadores de desempenho da tarefa atual
+	
+	@param p Contadores
+	
+	@return true quando ao menos um contador está disponível
+	
+	Os contadores incluem as threads criadas após a abertura, assim um cenário
+	com várias tarefas é medido por completo. Contadores não suportados pela
+	CPU ou bloqueados (perf_event_paranoid) ficam indisponíveis, com fd -1
+	
+	Exemplo:
+		map2_host_perf_t perf;
+		char text[256];
+		map2_host_perf_open(&perf);
+		map2_host_perf_start(&perf);
+		for (int i = 0; i < N; i++)
+			map2_readonly_try(&my_map1, i % ROWS, 0, map2_key(&my_map1, i % ROWS), item, 10, {});
+		map2_host_perf_stop(&perf);
+		map2_host_perf_report(&perf, N, text, sizeof(text));
+		map2_host_perf_close(&perf);
+*/
+bool map2_host_perf_open(map2_host_perf_t *p) {
+	MAP2_ASSERT(p == NULL, return false);
+	
+	bool open = false;
+	
+	for (int i = 0; i < MAP2_HOST_PERF_COUNT; i++) {
+		struct perf_event_attr attr;
+		
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = map2_host_perf_desc[i].type;
+		attr.config = map2_host_perf_desc[i].config;
+		attr.disabled = 1;
+		attr.inherit = 1;
+		attr.exclude_kernel = map2_host_perf_desc[i].type != PERF_TYPE_SOFTWARE;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		
+		p->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		p->value[i] = 0;
+		
+		if (p->fd[i] < 0)
+			dbgW("Perf counter unavailable %s\n", map2_host_perf_desc[i].name);
+		else
+			open = true;
+	}
+	
+	return open;
+}
+
+/**
+	@brief Zera e inicia os contadores
+*/
+void map2_host_perf_start(map2_host_perf_t *p) {
+	MAP2_ASSERT(p == NULL, return);
+	
+	for (int i = 0; i < MAP2_HOST_PERF_COUNT; i++) {
+		if (p->fd[i] >= 0) {
+			ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+/**
+	@brief Para os contadores e lê os valores
+	
+	@note Quando há mais contadores que registros na CPU o kernel os alterna,
+	os valores são então ajustados pelo tempo em que cada contador esteve ativo
+*/
+void map2_host_perf_stop(map2_host_perf_t *p) {
+	MAP2_ASSERT(p == NULL, return);
+	
+	for (int i = 0; i < MAP2_HOST_PERF_COUNT; i++) {
+		if (p->fd[i] >= 0)
+			ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+	
+	for (int i = 0; i < MAP2_HOST_PERF_COUNT; i++) {
+		uint64_t v[3];	// valor, tempo habilitado, tempo ativo
+		
+		p->value[i] = 0;
+		
+		if (p->fd[i] < 0 || read(p->fd[i], v, sizeof(v)) != sizeof(v))
+			continue;
+		
+		p->value[i] = v[2] != 0 && v[2] < v[1] ? (uint64_t)((double)v[0] * v[1] / v[2]) : v[0];
+	}
+}
+
+/**
+	@brief Fecha os contadores
+*/
+void map2_host_perf_close(map2_host_perf_t *p) {
+	MAP2_ASSERT(p == NULL, return);
+	
+	for (int i = 0; i < MAP2_HOST_PERF_COUNT; i++) {
+		if (p->fd[i] >= 0)
+			close(p->fd[i]);
+		p->fd[i] = -1;
+	}
+}
+
+/**
+	@brief Relatório dos contadores por operação
+	
+	@param p Contadores lidos com map2_host_perf_stop(..)
+	@param ops Quantidade de operações do cenário medido
+	@param buf Destino do texto
+	@param len Tamanho de 'buf'
+	
+	@return Tamanho do texto completo, como snprintf
+	
+	Formato: 'cycles/op=41.2 instructions/op=97.0 ... ipc=2.35', contadores
+	indisponíveis são omitidos. Um IPC baixo com muitas faltas de cache
+	indica custo de memória, muitas trocas de contexto indicam custo de
+	sincronização
+*/
+size_t map2_host_perf_report(const map2_host_perf_t *p, uint64_t ops, char *buf, size_t len) {
+	MAP2_ASSERT(p == NULL || ops == 0 || (buf == NULL && len != 0), return 0);
+	
+	map2_host_text_t t = {.buf = buf, .len = len, .pos = 0};
+	
+	if (len != 0)
+		buf[0] = '\0';
+	
+	for (int i = 0; i < MAP2_HOST_PERF_COUNT; i++) {
+		if (p->fd[i] >= 0)
+			__map2_host_printf(&t, "%s%s/op=%.3f", t.pos != 0 ? " " : "", map2_host_perf_desc[i].name, (double)p->value[i] / (double)ops);
+	}
+	
+	if (p->fd[MAP2_HOST_PERF_CYCLES] >= 0 && p->fd[MAP2_HOST_PERF_INSTRUCTIONS] >= 0 && p->value[MAP2_HOST_PERF_CYCLES] != 0)
+		__map2_host_printf(&t, " ipc=%.2f", (double)p->value[MAP2_HOST_PERF_INSTRUCTIONS] / (double)p->value[MAP2_HOST_PERF_CYCLES]);
+	
+	return t.pos;
+}
+
+/**
+	Cabeçalho do arquivo de acessos gravados, seguido pelos nomes dos mapas
+	(MAP2_HOST_RECORD_NAME bytes cada) e pelos registros (map2_record_t)
+	
+	@def MAP2_HOST_RECORD_VERSION Versão do formato, 2 com posições de 32 bits
+	@def MAP2_HOST_RECORD_NAME Tamanho do nome de um mapa no arquivo
+	@def MAP2_HOST_REPLAY_TASKS Quantidade máxima de tarefas reproduzidas
+*/
+#define MAP2_HOST_RECORD_MAGIC		"MAP2REC"
+#define MAP2_HOST_RECORD_VERSION	(2)
+#define MAP2_HOST_RECORD_NAME		(32)
+#define MAP2_HOST_REPLAY_TASKS		(64)
+
+typedef struct {
+	char magic[8];		/** MAP2_HOST_RECORD_MAGIC */
+	uint32_t version;	/** MAP2_HOST_RECORD_VERSION */
+	uint32_t unit_ns;	/** Duração de uma unidade de tempo dos registros */
+	uint32_t maps;		/** Quantidade de nomes de mapas */
+	uint32_t record;	/** sizeof(map2_record_t) */
+}
+map2_host_record_hdr_t;
+
+/**
+	@brief Instante atual em nanossegundos
+*/
+static uint64_t __map2_host_now(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+	@brief Cria o arquivo de gravação de acessos e habilita a gravação
+	
+	@param path Caminho do arquivo
+	@param unit_ns Duração de uma unidade de MAP2_TIMESTAMP() em nanossegundos,
+	1 no host ou, a duração do tick quando os registros vêm do RTOS
+	
+	@return Arquivo aberto ou, NULL em caso de erro
+	
+	Os nomes dos mapas registrados são gravados no cabeçalho, assim a
+	reprodução localiza os mapas pelo nome. Crie o arquivo após inicializar
+	os mapas com map2_init(..)
+	
+	Exemplo:
+		uint32_t cursor = 0;
+		FILE *f = map2_host_record_create("/tmp/gateway.rec", 1);
+		while (running) {
+			map2_host_record_save(f, &cursor);
+			usleep(1000);
+		}
+		map2_record_enable(false);
+		fclose(f);
+	
+	@note Requer MAP2_CONFIG_RECORD
+*/
+FILE *map2_host_record_create(const char *path, uint32_t unit_ns) {
+	MAP2_ASSERT(path == NULL || unit_ns == 0, return NULL);
+	
+	map2_host_record_hdr_t hdr = {
+		.magic = MAP2_HOST_RECORD_MAGIC,
+		.version = MAP2_HOST_RECORD_VERSION,
+		.unit_ns = unit_ns,
+		.maps = (uint32_t)map2_registry_count(),
+		.record = sizeof(map2_record_t),
+	};
+	FILE *f = fopen(path, "wb");
+	
+	MAP2_ASSERT(f == NULL, return NULL);
+	
+	bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+	
+	for (uint32_t i = 0; ok && i < hdr.maps; i++) {
+		char name[MAP2_HOST_RECORD_NAME] = {0};
+		const map2_t *m = map2_registry_get((int)i);
+		
+		if (m->name != NULL)
+			strncpy(name, m->name, sizeof(name) - 1);
+		ok = fwrite(name, sizeof(name), 1, f) == 1;
+	}
+	
+	MAP2_ASSERT(!ok, {
+		fclose(f);
+		return NULL;
+	});
+	
+	map2_record_enable(true);
+	return f;
+}
+
+/**
+	@brief Grava no arquivo os acessos registrados desde a última chamada
+	
+	@param f Arquivo criado com map2_host_record_create(..)
+	@param cursor Cursor de leitura, ver map2_record_read(..)
+	
+	@return Quantidade de registros gravados ou, -1 em caso de erro
+*/
+int map2_host_record_save(FILE *f, uint32_t *cursor) {
+	MAP2_ASSERT(f == NULL || cursor == NULL, return -1);
+	
+	map2_record_t rec[256];
+	int total = 0;
+	int n;
+	
+	while ((n = map2_record_read(cursor, rec, 256)) > 0) {
+		MAP2_ASSERT(fwrite(rec, sizeof(rec[0]), (size_t)n, f) != (size_t)n, return -1);
+		total += n;
+	}
+	
+	return total;
+}
+
+/**
+	Estado compartilhado da reprodução
+*/
+typedef struct {
+	map2_record_t *rec;
+	uint64_t *at;				/** Instante de cada registro, em ns desde o primeiro */
+	size_t n;
+	const map2_t **maps;
+	uint32_t maps_count;
+	uint32_t unit_ns;
+	uint32_t tout;
+	bool paced;
+	size_t buf_size;
+	uint64_t start;
+	pthread_rwlock_t gate;	/** Alocado pela thread principal até o início */
+	bool abort;				/** Reprodução cancelada antes do início */
+	map2_host_replay_t *result;
+}
+map2_host_replay_ctx_t;
+
+typedef struct {
+	map2_host_replay_ctx_t *ctx;
+	uint16_t task;
+}
+map2_host_replay_task_t;
+
+/**
+	@brief Reproduz os acessos de uma tarefa gravada
+*/
+static void *__map2_host_replay_task(void *arg) {
+	map2_host_replay_task_t *rt = arg;
+	map2_host_replay_ctx_t *ctx = rt->ctx;
+	map2_host_replay_t *res = ctx->result;
+	void *buf = malloc(ctx->buf_size);
+	
+	// Aguarda todas as threads serem criadas
+	pthread_rwlock_rdlock(&ctx->gate);
+	pthread_rwlock_unlock(&ctx->gate);
+	
+	for (size_t i = 0; buf != NULL && !ctx->abort && i < ctx->n; i++) {
+		const map2_record_t *r = &ctx->rec[i];
+		
+		if (r->task != rt->task)
+			continue;
+		
+		const map2_t *m = r->map < ctx->maps_count ? ctx->maps[r->map] : NULL;
+		int key = m != NULL && r->row < m->rows && r->column < m->columns ? map2_key(m, r->row) : -1;
+		
+		// Escritas de itens indiretos (map2_indirect_put) trocam blocos do
+		// pool e não são reproduzidas
+		if (key >= 0 && m->slab != NULL && r->op == MAP2_OP_READWRITE)
+			key = -1;
+		
+		if (key < 0) {
+			MAP2_ATOMIC_FETCH_ADD(&res->skipped, 1);
+			continue;
+		}
+		
+		while (ctx->paced && __map2_host_now() - ctx->start < ctx->at[i])
+			MAP2_CPU_RELAX();
+		
+		uint64_t t = __map2_host_now();
+		void *p = r->column < 0 ?
+			__map2_take_row(m, r->row, key, buf, (size_t)m->columns * m->field_size, ctx->tout, (map2_operation_t)r->op) :
+			__map2_take(m, r->row, r->column, key, buf, ctx->tout, (map2_operation_t)r->op);
+		uint64_t now = __map2_host_now();
+		
+		map2_hist_add(&res->wait, (uint32_t)(now - t < 0xFFFFFFFFu ? now - t : 0xFFFFFFFFu));
+		
+		if (p == NULL) {
+			MAP2_ATOMIC_FETCH_ADD(&res->timeouts, 1);
+			continue;
+		}
+		
+		MAP2_ATOMIC_FETCH_ADD(&res->ops, 1);
+		
+		// No modo somente leitura a chave já foi liberada após a cópia
+		if (r->op == MAP2_OP_READWRITE) {
+			uint64_t hold = (uint64_t)r->hold * ctx->unit_ns;
+			
+			while (__map2_host_now() - now < hold)
+				MAP2_CPU_RELAX();
+			
+			if (r->column < 0)
+				__map2_drop_row(m, r->row, key);
+			else
+				__map2_drop(m, r->row, r->column, key);
+		}
+	}
+	
+	free(buf);
+	return NULL;
+}
+
+/**
+	@brief Lê o arquivo de acessos gravados
+	
+	@return true quando o arquivo é válido, os buffers alocados em 'ctx'
+	devem ser liberados mesmo em caso de erro
+*/
+static bool __map2_host_replay_load(FILE *f, map2_host_replay_ctx_t *ctx) {
+	map2_host_record_hdr_t hdr;
+	
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, MAP2_HOST_RECORD_MAGIC, sizeof(MAP2_HOST_RECORD_MAGIC)) != 0)
+		return false;
+	
+	MAP2_ASSERT(hdr.version != MAP2_HOST_RECORD_VERSION || hdr.record != sizeof(map2_record_t), return false);
+	
+	ctx->maps = calloc(hdr.maps + 1, sizeof(*ctx->maps));
+	ctx->maps_count = hdr.maps;
+	ctx->unit_ns = hdr.unit_ns;
+	ctx->buf_size = 1;
+	
+	MAP2_ASSERT(ctx->maps == NULL, return false);
+	
+	for (uint32_t i = 0; i < hdr.maps; i++) {
+		char name[MAP2_HOST_RECORD_NAME];
+		
+		if (fread(name, sizeof(name), 1, f) != 1)
+			return false;
+		name[sizeof(name) - 1] = '\0';
+		
+		const map2_t *m = map2_registry_find(name);
+		
+		if (m == NULL)
+			dbgW("Map not registered %s\n", name);
+		else if ((size_t)m->columns * m->field_size > ctx->buf_size)
+			ctx->buf_size = (size_t)m->columns * m->field_size;
+		
+		ctx->maps[i] = m;
+	}
+	
+	long pos = ftell(f);
+	
+	fseek(f, 0, SEEK_END);
+	ctx->n = (size_t)(ftell(f) - pos) / sizeof(map2_record_t);
+	fseek(f, pos, SEEK_SET);
+	
+	ctx->rec = malloc(ctx->n * sizeof(*ctx->rec) + 1);
+	ctx->at = malloc(ctx->n * sizeof(*ctx->at) + 1);
+	
+	if (ctx->rec == NULL || ctx->at == NULL || fread(ctx->rec, sizeof(*ctx->rec), ctx->n, f) != ctx->n)
+		return false;
+	
+	// Instantes em 64 bits, os instantes gravados de 32 bits podem estourar
+	for (size_t i = 0; i < ctx->n; i++)
+		ctx->at[i] = i == 0 ? 0 : ctx->at[i - 1] + (uint64_t)(uint32_t)(ctx->rec[i].stamp - ctx->rec[i - 1].stamp) * hdr.unit_ns;
+	
+	return true;
+}
+
+/**
+	@brief Reproduz acessos gravados nos mapas registrados
+	
+	@param path Arquivo criado com map2_host_record_create(..)
+	@param tout Timeout de acesso, em ticks
+	@param paced true para respeitar os instantes gravados ou, false para
+	reproduzir os acessos o mais rápido possível
+	@param result Destino do resultado
+	
+	@return true quando o arquivo foi reproduzido
+	
+	Os mapas são localizados pelo nome com map2_registry_find(..), assim a
+	mesma gravação pode ser reproduzida com outra configuração do mapa
+	(tipo de trava, chaves, MAP2_KEYMAP, MAP2_ADAPTIVE) desde que o nome e as
+	dimensões sejam compatíveis. Cada tarefa gravada é reproduzida por uma
+	thread, mantendo a ordem dos seus acessos. O tempo com a chave alocada é
+	reproduzido nos acessos de leitura e escrita
+	
+	Exemplo:
+		map2_host_replay_t r;
+		if (map2_host_replay("/tmp/gateway.rec", 100, false, &r))
+			printf("%.0f op/s p99 %u ns\n", r.throughput, map2_hist_quantile(&r.wait, 99, 100));
+*/
+bool map2_host_replay(const char *path, uint32_t tout, bool paced, map2_host_replay_t *result) {
+	MAP2_ASSERT(path == NULL || result == NULL, return false);
+	
+	map2_host_replay_ctx_t ctx = {.tout = tout, .paced = paced, .result = result};
+	map2_host_replay_task_t tasks[MAP2_HOST_REPLAY_TASKS];
+	pthread_t threads[MAP2_HOST_REPLAY_TASKS];
+	uint32_t ntasks = 0;
+	FILE *f = fopen(path, "rb");
+	
+	MAP2_ASSERT(f == NULL, return false);
+	
+	memset(result, 0, sizeof(*result));
+	
+	bool ok = __map2_host_replay_load(f, &ctx);
+	
+	fclose(f);
+	
+	MAP2_ASSERT(!ok, {
+		dbgW("Invalid record file %s\n", path);
+		free(ctx.rec);
+		free(ctx.at);
+		free(ctx.maps);
+		return false;
+	});
+	
+	// Uma thread por tarefa gravada, tarefas além do limite são descartadas
+	for (size_t i = 0; i < ctx.n; i++) {
+		uint32_t t = 0;
+		
+		while (t < ntasks && tasks[t].task != ctx.rec[i].task)
+			t++;
+		
+		if (t == ntasks && ntasks < MAP2_HOST_REPLAY_TASKS) {
+			tasks[ntasks].ctx = &ctx;
+			tasks[ntasks++].task = ctx.rec[i].task;
+		}
+		else if (t == ntasks) {
+			ctx.rec[i].map = 0xFF;
+			result->skipped++;
+		}
+	}
+	
+	uint32_t created = 0;
+	
+	pthread_rwlock_init(&ctx.gate, NULL);
+	pthread_rwlock_wrlock(&ctx.gate);
+	
+	while (created < ntasks && pthread_create(&threads[created], NULL, __map2_host_replay_task, &tasks[created]) == 0)
+		created++;
+	
+	// Sem todas as threads a reprodução não representa a gravação, as
+	// threads criadas terminam sem reproduzir
+	ctx.abort = created < ntasks;
+	ctx.start = __map2_host_now();
+	pthread_rwlock_unlock(&ctx.gate);
+	
+	for (uint32_t t = 0; t < created; t++)
+		pthread_join(threads[t], NULL);
+	
+	pthread_rwlock_destroy(&ctx.gate);
+	
+	MAP2_ASSERT(ctx.abort, {
+		dbgW("Thread create failed tasks:%u created:%u\n", ntasks, created);
+		free(ctx.rec);
+		free(ctx.at);
+		free(ctx.maps);
+		return false;
+	});
+	
+	result->tasks = ntasks;
+	result->elapsed = __map2_host_now() - ctx.start;
+	result->throughput = result->elapsed != 0 ? (double)result->ops * 1e9 / (double)result->elapsed : 0;
+	
+	free(ctx.rec);
+	free(ctx.at);
+	free(ctx.maps);
+	return true;
+}
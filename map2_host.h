@@ -0,0 +1,117 @@
+/**
+	@file map2_host.h
+	@brief Header map2_host
+	
+	Recursos do map2 disponíveis apenas no host (Linux), utilizados em testes
+	de desempenho e nos gateways.
+	
+	@note Não utilize no firmware, estas funções dependem de chamadas de sistema
+	do Linux
+*/
+
+#ifndef __MAP2_HOST_H__
+#define __MAP2_HOST_H__
+
+#include "map2.h"
+
+#include <stdio.h>
+
+/**
+	Modos de página para os dados do mapa
+	
+	@def MAP2_HOST_PAGE_THP Páginas grandes transparentes (madvise)
+	@def MAP2_HOST_PAGE_EXPLICIT Páginas grandes explícitas (hugetlbfs), caso
+	não haja páginas reservadas no sistema utiliza MAP2_HOST_PAGE_THP
+	
+	@note MAP2_HOST_PAGE_EXPLICIT move a região hugetlbfs para os dados do
+	mapa com mremap(MREMAP_FIXED), suportado apenas em kernels recentes. Em
+	kernels sem suporte a falha é registrada (DBG_ENABLE) e os dados passam a
+	utilizar MAP2_HOST_PAGE_THP, verifique AnonHugePages em /proc/<pid>/smaps
+*/
+typedef enum {
+	MAP2_HOST_PAGE_THP = 0,
+	MAP2_HOST_PAGE_EXPLICIT,
+}
+map2_host_page_t;
+
+/**
+	Política de alocação de memória NUMA
+	
+	@def MAP2_HOST_NUMA_PREFERRED Prefere o nó, utiliza outros quando cheio
+	@def MAP2_HOST_NUMA_BIND Aloca somente no nó
+*/
+typedef enum {
+	MAP2_HOST_NUMA_PREFERRED = 0,
+	MAP2_HOST_NUMA_BIND,
+}
+map2_host_numa_t;
+
+/**
+	Acessos agrupados por local de chamada, ver map2_host_sample_sites(..)
+*/
+typedef struct {
+	uintptr_t site;			/** Endereço de onde o acesso foi requisitado */
+	uint32_t count;			/** Quantidade de amostras */
+	uint64_t wait_total;	/** Soma do tempo aguardando a chave */
+	uint32_t wait_max;		/** Maior tempo aguardando a chave */
+	uint64_t hold_total;	/** Soma do tempo com a chave alocada */
+	uint32_t hold_max;		/** Maior tempo com a chave alocada */
+}
+map2_host_site_t;
+
+/**
+	Contadores de desempenho (perf_event), ver map2_host_perf_open(..)
+	
+	@def MAP2_HOST_PERF_CYCLES Ciclos de CPU
+	@def MAP2_HOST_PERF_INSTRUCTIONS Instruções executadas
+	@def MAP2_HOST_PERF_L1D_MISSES Faltas de leitura na cache L1 de dados
+	@def MAP2_HOST_PERF_LLC_MISSES Faltas na cache de último nível
+	@def MAP2_HOST_PERF_BRANCH_MISSES Desvios previstos incorretamente
+	@def MAP2_HOST_PERF_CONTEXT_SWITCHES Trocas de contexto
+*/
+typedef enum {
+	MAP2_HOST_PERF_CYCLES = 0,
+	MAP2_HOST_PERF_INSTRUCTIONS,
+	MAP2_HOST_PERF_L1D_MISSES,
+	MAP2_HOST_PERF_LLC_MISSES,
+	MAP2_HOST_PERF_BRANCH_MISSES,
+	MAP2_HOST_PERF_CONTEXT_SWITCHES,
+	MAP2_HOST_PERF_COUNT,
+}
+map2_host_perf_event_t;
+
+typedef struct {
+	int fd[MAP2_HOST_PERF_COUNT];			/** Descritor de cada contador, -1 quando indisponível */
+	uint64_t value[MAP2_HOST_PERF_COUNT];	/** Valores da última medição */
+}
+map2_host_perf_t;
+
+/**
+	Resultado da reprodução de acessos gravados, ver map2_host_replay(..)
+*/
+typedef struct {
+	uint64_t ops;			/** Acessos alocados */
+	uint64_t timeouts;		/** Acessos não alocados (timeout) */
+	uint64_t skipped;		/** Registros de mapas ou posições inexistentes e escritas de itens indiretos */
+	uint32_t tasks;			/** Tarefas reproduzidas, uma thread por tarefa gravada */
+	uint64_t elapsed;		/** Duração da reprodução, em nanossegundos */
+	double throughput;		/** Acessos alocados por segundo */
+	map2_hist_t wait;		/** Tempo aguardando a chave, em nanossegundos */
+}
+map2_host_replay_t;
+
+bool map2_host_hugepage(const map2_t *m, map2_host_page_t mode);
+size_t map2_host_numa_bind(const map2_t *m, int key, int node, map2_host_numa_t policy);
+int map2_host_sample_sites(const map2_sample_t *samples, int n, map2_host_site_t *sites, int max);
+const char *map2_host_site_name(uintptr_t site, char *buf, size_t len);
+size_t map2_host_metrics(char *buf, size_t len);
+bool map2_host_perf_open(map2_host_perf_t *p);
+void map2_host_perf_start(map2_host_perf_t *p);
+void map2_host_perf_stop(map2_host_perf_t *p);
+void map2_host_perf_close(map2_host_perf_t *p);
+size_t map2_host_perf_report(const map2_host_perf_t *p, uint64_t ops, char *buf, size_t len);
+FILE *map2_host_record_create(const char *path, uint32_t unit_ns);
+int map2_host_record_save(FILE *f, uint32_t *cursor);
+bool map2_host_replay(const char *path, uint32_t tout, bool paced, map2_host_replay_t *result);
+
+#endif
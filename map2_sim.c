@@ -0,0 +1,399 @@
+#include "map2.h"
+
+#ifndef MAP2_CONFIG_SIM
+#error "map2_sim.c requires MAP2_CONFIG_SIM"
+#endif
+
+#include <stddef.h>
+#include <string.h>
+#include <ucontext.h>
+
+#define DBG_MODULE "map2_sim"
+#include "shared/dbg.h"
+
+/**
+	@def MAP2_SIM_FOREVER Instante de uma tarefa sem timeout
+*/
+#define MAP2_SIM_FOREVER	(0xFFFFFFFFu)
+
+/**
+	Estados de uma tarefa simulada
+*/
+typedef enum {
+	MAP2_SIM_FREE = 0,
+	MAP2_SIM_READY,
+	MAP2_SIM_DELAY,
+	MAP2_SIM_MUTEX,
+	MAP2_SIM_DONE,
+}
+map2_sim_state_t;
+
+/**
+	Mutex simulado, armazenado no OS_MUT do mapa
+*/
+typedef struct {
+	U32 owner;	/** Tarefa dona do mutex, 0 quando livre */
+	U32 level;	/** Quantidade de alocações da tarefa dona (recursivo) */
+	U32 init;	/** Inicializado com os_mut_init(..) */
+}
+map2_sim_mut_t;
+
+_Static_assert(sizeof(map2_sim_mut_t) <= sizeof(OS_MUT), "OS_MUT too small");
+
+typedef struct {
+	ucontext_t ctx;
+	map2_sim_state_t state;
+	U8 base;				/** Prioridade da tarefa */
+	U8 prio;				/** Prioridade efetiva (herança de prioridade) */
+	U32 seq;				/** Ordem em que ficou pronta ou aguardando */
+	U32 wake;				/** Instante do timeout */
+	map2_sim_mut_t *mut;	/** Mutex aguardado */
+	OS_RESULT result;		/** Resultado de os_mut_wait(..) */
+	void (*fnc)(void *arg);
+	void *arg;
+}
+map2_sim_task_t;
+
+static map2_sim_task_t __map2_sim_tasks[MAP2_CONFIG_SIM_TASKS];
+static uint8_t __map2_sim_stacks[MAP2_CONFIG_SIM_TASKS][MAP2_CONFIG_SIM_STACK] __attribute__((aligned(16)));
+static ucontext_t __map2_sim_sched;
+static map2_sim_task_t *__map2_sim_cur;
+static U32 __map2_sim_tick;
+static U32 __map2_sim_seq;
+
+#define __map2_sim_tid(t)		((OS_TID)((t) - __map2_sim_tasks) + 1)
+
+/**
+	@brief Retorna ao escalonador, a tarefa atual deve ter alterado seu estado
+*/
+static void __map2_sim_switch(void) {
+	swapcontext(&__map2_sim_cur->ctx, &__map2_sim_sched);
+}
+
+/**
+	@brief Coloca uma tarefa no final da fila de tarefas prontas da sua
+	prioridade
+*/
+static void __map2_sim_ready(map2_sim_task_t *t) {
+	t->state = MAP2_SIM_READY;
+	t->seq = ++__map2_sim_seq;
+	t->wake = MAP2_SIM_FOREVER;
+}
+
+/**
+	@brief Tarefa de maior prioridade em um estado, em empate a mais antiga
+	
+	@param state Estado da tarefa
+	@param mut Mutex aguardado ou, NULL para qualquer
+*/
+static map2_sim_task_t *__map2_sim_pick(map2_sim_state_t state, const map2_sim_mut_t *mut) {
+	map2_sim_task_t *best = NULL;
+	
+	for (int i = 0; i < MAP2_CONFIG_SIM_TASKS; i++) {
+		map2_sim_task_t *t = &__map2_sim_tasks[i];
+		
+		if (t->state != state || (mut != NULL && t->mut != mut))
+			continue;
+		if (best == NULL || t->prio > best->prio || (t->prio == best->prio && t->seq < best->seq))
+			best = t;
+	}
+	
+	return best;
+}
+
+/**
+	@brief Tarefa dona do mutex
+	
+	@return Tarefa ou, NULL quando o mutex está livre
+*/
+static map2_sim_task_t *__map2_sim_owner(const map2_sim_mut_t *mu) {
+	return mu != NULL && mu->owner != 0 ? &__map2_sim_tasks[mu->owner - 1] : NULL;
+}
+
+/**
+	@brief Recalcula a prioridade efetiva (herança de prioridade)
+	
+	A prioridade efetiva é a maior entre a prioridade da tarefa e as das
+	tarefas aguardando os mutexes que ela possui. Quando a tarefa também
+	aguarda um mutex, a alteração é propagada para o dono desse mutex
+	
+	@param t Tarefa ou, NULL
+*/
+static void __map2_sim_inherit(map2_sim_task_t *t) {
+	while (t != NULL) {
+		OS_TID tid = __map2_sim_tid(t);
+		U8 prio = t->base;
+		
+		for (int i = 0; i < MAP2_CONFIG_SIM_TASKS; i++) {
+			const map2_sim_task_t *w = &__map2_sim_tasks[i];
+			
+			if (w->state == MAP2_SIM_MUTEX && w->mut != NULL && w->mut->owner == tid && w->prio > prio)
+				prio = w->prio;
+		}
+		
+		if (prio == t->prio)
+			return;
+		
+		t->prio = prio;
+		t = t->state == MAP2_SIM_MUTEX ? __map2_sim_owner(t->mut) : NULL;
+	}
+}
+
+/**
+	@brief Entrada das tarefas simuladas
+*/
+static void __map2_sim_entry(void) {
+	__map2_sim_cur->fnc(__map2_sim_cur->arg);
+	__map2_sim_cur->state = MAP2_SIM_DONE;
+	__map2_sim_switch();
+}
+
+/**
+	@brief Reinicia o simulador, descartando todas as tarefas
+	
+	@note O tempo virtual volta a 0
+*/
+void map2_sim_init(void) {
+	memset(__map2_sim_tasks, 0, sizeof(__map2_sim_tasks));
+	__map2_sim_cur = NULL;
+	__map2_sim_tick = 0;
+	__map2_sim_seq = 0;
+}
+
+/**
+	@brief Cria uma tarefa simulada
+	
+	@param fnc Função da tarefa
+	@param arg Argumento de 'fnc'
+	@param prio Prioridade, maior valor executa primeiro (como no RTX)
+	
+	@return Identificação da tarefa ou, 0 quando não há espaço
+	
+	@note A tarefa só executa em map2_sim_run(..)
+*/
+OS_TID map2_sim_task(void (*fnc)(void *arg), void *arg, U8 prio) {
+	MAP2_ASSERT(fnc == NULL, return 0);
+	
+	for (int i = 0; i < MAP2_CONFIG_SIM_TASKS; i++) {
+		map2_sim_task_t *t = &__map2_sim_tasks[i];
+		
+		if (t->state != MAP2_SIM_FREE)
+			continue;
+		
+		memset(t, 0, sizeof(*t));
+		getcontext(&t->ctx);
+		t->ctx.uc_stack.ss_sp = __map2_sim_stacks[i];
+		t->ctx.uc_stack.ss_size = sizeof(__map2_sim_stacks[i]);
+		t->ctx.uc_link = &__map2_sim_sched;
+		makecontext(&t->ctx, __map2_sim_entry, 0);
+		
+		t->fnc = fnc;
+		t->arg = arg;
+		t->base = prio;
+		t->prio = prio;
+		__map2_sim_ready(t);
+		
+		return __map2_sim_tid(t);
+	}
+	
+	dbgW("No free task slot\n");
+	return 0;
+}
+
+/**
+	@brief Executa as tarefas simuladas
+	
+	@param until Instante virtual máximo
+	
+	@return true quando todas as tarefas terminaram ou, false quando o tempo
+	acabou ou as tarefas restantes aguardam para sempre (deadlock)
+	
+	Pode ser chamada novamente para continuar a simulação a partir do instante
+	atual, ver os_time_get(..)
+*/
+bool map2_sim_run(U32 until) {
+	MAP2_ASSERT(__map2_sim_cur != NULL, return false);
+	
+	for (;;) {
+		map2_sim_task_t *t = __map2_sim_pick(MAP2_SIM_READY, NULL);
+		
+		if (t != NULL) {
+			__map2_sim_cur = t;
+			swapcontext(&__map2_sim_sched, &t->ctx);
+			__map2_sim_cur = NULL;
+			continue;
+		}
+		
+		// Nenhuma tarefa pronta, avança o tempo até o próximo timeout
+		U32 next = MAP2_SIM_FOREVER;
+		bool pending = false;
+		
+		for (int i = 0; i < MAP2_CONFIG_SIM_TASKS; i++) {
+			t = &__map2_sim_tasks[i];
+			
+			if (t->state == MAP2_SIM_DELAY || t->state == MAP2_SIM_MUTEX) {
+				pending = true;
+				if (t->wake < next)
+					next = t->wake;
+			}
+		}
+		
+		if (!pending)
+			return true;
+		
+		if (next == MAP2_SIM_FOREVER) {
+			dbgW("Deadlock tick:%u\n", __map2_sim_tick);
+			return false;
+		}
+		
+		if (next > until) {
+			__map2_sim_tick = until;
+			return false;
+		}
+		
+		__map2_sim_tick = next;
+		
+		for (int i = 0; i < MAP2_CONFIG_SIM_TASKS; i++) {
+			t = &__map2_sim_tasks[i];
+			
+			if ((t->state != MAP2_SIM_DELAY && t->state != MAP2_SIM_MUTEX) || t->wake != next)
+				continue;
+			
+			map2_sim_mut_t *mu = t->state == MAP2_SIM_MUTEX ? t->mut : NULL;
+			
+			if (mu != NULL) {
+				t->mut = NULL;
+				t->result = OS_R_TMO;
+			}
+			__map2_sim_ready(t);
+			
+			// A tarefa deixou de aguardar, desfaz a herança no dono do mutex
+			if (mu != NULL)
+				__map2_sim_inherit(__map2_sim_owner(mu));
+		}
+	}
+}
+
+void os_mut_init(OS_ID mutex) {
+	map2_sim_mut_t *mu = mutex;
+	
+	MAP2_ASSERT(mu == NULL, return);
+	
+	mu->owner = 0;
+	mu->level = 0;
+	mu->init = 1;
+}
+
+/**
+	@brief Aguarda o mutex, com herança de prioridade
+	
+	@return OS_R_OK quando o mutex estava livre, OS_R_MUT quando a tarefa
+	aguardou o mutex ou, OS_R_TMO no timeout
+	
+	@note Fora das tarefas simuladas (por exemplo, em map2_init) não há espera,
+	o mutex ocupado retorna OS_R_TMO
+*/
+OS_RESULT os_mut_wait(OS_ID mutex, U16 timeout) {
+	map2_sim_mut_t *mu = mutex;
+	map2_sim_task_t *t = __map2_sim_cur;
+	OS_TID self = os_tsk_self();
+	
+	MAP2_ASSERT(mu == NULL || !mu->init, return OS_R_NOK);
+	
+	if (mu->level == 0 || mu->owner == self) {
+		mu->owner = self;
+		mu->level++;
+		return OS_R_OK;
+	}
+	
+	if (timeout == 0 || t == NULL)
+		return OS_R_TMO;
+	
+	t->state = MAP2_SIM_MUTEX;
+	t->mut = mu;
+	t->seq = ++__map2_sim_seq;
+	t->wake = timeout == 0xFFFF ? MAP2_SIM_FOREVER : __map2_sim_tick + timeout;
+	__map2_sim_inherit(__map2_sim_owner(mu));
+	__map2_sim_switch();
+	
+	return t->result;
+}
+
+/**
+	@brief Libera o mutex, passando-o para a tarefa de maior prioridade
+	aguardando
+	
+	@note Quando a tarefa que recebe o mutex tem prioridade maior, a tarefa
+	atual é preemptada
+*/
+OS_RESULT os_mut_release(OS_ID mutex) {
+	map2_sim_mut_t *mu = mutex;
+	map2_sim_task_t *t = __map2_sim_cur;
+	
+	MAP2_ASSERT(mu == NULL || mu->owner != os_tsk_self() || mu->level == 0, return OS_R_NOK);
+	
+	if (--mu->level != 0)
+		return OS_R_OK;
+	
+	map2_sim_task_t *w = __map2_sim_pick(MAP2_SIM_MUTEX, mu);
+	
+	if (w == NULL) {
+		mu->owner = 0;
+		__map2_sim_inherit(t);
+		return OS_R_OK;
+	}
+	
+	mu->owner = __map2_sim_tid(w);
+	mu->level = 1;
+	w->mut = NULL;
+	w->result = OS_R_MUT;
+	__map2_sim_ready(w);
+	
+	// Mantém a herança dos mutexes que a tarefa ainda possui, e os demais
+	// aguardando o mutex passam a herdar para a nova dona
+	__map2_sim_inherit(t);
+	__map2_sim_inherit(w);
+	
+	if (t != NULL && w->prio > t->prio) {
+		__map2_sim_ready(t);
+		__map2_sim_switch();
+	}
+	
+	return OS_R_OK;
+}
+
+/**
+	@return Identificação da tarefa atual ou, 0 fora das tarefas simuladas
+*/
+OS_TID os_tsk_self(void) {
+	return __map2_sim_cur != NULL ? __map2_sim_tid(__map2_sim_cur) : 0;
+}
+
+/**
+	@brief Passa a vez para a próxima tarefa pronta de mesma prioridade
+*/
+void os_tsk_pass(void) {
+	MAP2_ASSERT(__map2_sim_cur == NULL, return);
+	
+	__map2_sim_ready(__map2_sim_cur);
+	__map2_sim_switch();
+}
+
+/**
+	@brief Aguarda ticks virtuais
+*/
+void os_dly_wait(U16 delay) {
+	MAP2_ASSERT(__map2_sim_cur == NULL, return);
+	
+	__map2_sim_cur->state = MAP2_SIM_DELAY;
+	__map2_sim_cur->seq = ++__map2_sim_seq;
+	__map2_sim_cur->wake = __map2_sim_tick + delay;
+	__map2_sim_switch();
+}
+
+/**
+	@return Instante virtual atual, em ticks
+*/
+U32 os_time_get(void) {
+	return __map2_sim_tick;
+}
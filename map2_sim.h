@@ -0,0 +1,100 @@
+/**
+	@file map2_sim.h
+	@brief Header map2_sim
+	
+	Simulador determinístico do RTX no host (Linux), com tempo virtual e
+	escalonamento por prioridade, para reproduzir cenários de latência e
+	inanição do map2 exatamente e medi-los em ticks virtuais.
+	
+	Com MAP2_CONFIG_SIM definido o map2.h utiliza este header no lugar do
+	RTL.h, e as funções do RTX utilizadas pelo map2 (os_mut_*, os_tsk_self,
+	os_tsk_pass, os_dly_wait e os_time_get) são implementadas pelo simulador.
+	
+	Comportamento simulado:
+		- A tarefa pronta de maior prioridade executa, tarefas de mesma
+		prioridade executam na ordem em que ficaram prontas
+		- O processamento entre chamadas ao RTX não consome tempo, o tempo
+		virtual só avança quando todas as tarefas estão aguardando
+		- Mutex recursivo com herança de prioridade, a fila de espera é
+		ordenada por prioridade
+		- Timeout em ticks, 0xFFFF aguarda para sempre (ver __map2_take)
+	
+	Exemplo:
+		static void producer(void *arg) {
+			for (int i = 0; i < 100; i++) {
+				map2_readwrite_try(&my_map1, 0, 0, 0, item, 10, { item->value = i; });
+				os_dly_wait(1);
+			}
+		}
+		
+		map2_sim_init();
+		map2_init(&my_map1, {});
+		map2_sim_task(producer, NULL, 2);
+		map2_sim_task(consumer, NULL, 1);
+		map2_sim_run(1000);
+	
+	@note Não utilize no firmware. As tarefas são corrotinas (ucontext) de uma
+	única thread, não utilize map2_sim junto com threads do sistema
+*/
+
+#ifndef __MAP2_SIM_H__
+#define __MAP2_SIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+	Tipos e resultados do RTX
+*/
+typedef uint8_t U8;
+typedef uint16_t U16;
+typedef uint32_t U32;
+typedef void *OS_ID;
+typedef U32 OS_TID;
+typedef U32 OS_RESULT;
+typedef U32 OS_MUT[3];
+
+#define OS_R_OK		0
+#define OS_R_TMO	1
+#define OS_R_MUT	5
+#define OS_R_NOK	0xFF
+
+/**
+	Configuração da placa base utilizada pela política de chaves, redefina
+	conforme o hardware simulado
+*/
+#ifndef SLOT_CNT
+#define SLOT_CNT		4
+#endif
+#ifndef SLOT_CH
+#define SLOT_CH			4
+#endif
+#ifndef UART_INSTANCES
+#define UART_INSTANCES	2
+#endif
+
+/**
+	@def MAP2_CONFIG_SIM_TASKS Quantidade máxima de tarefas simuladas
+	@def MAP2_CONFIG_SIM_STACK Tamanho da pilha de cada tarefa
+*/
+#ifndef MAP2_CONFIG_SIM_TASKS
+#define MAP2_CONFIG_SIM_TASKS	(16)
+#endif
+
+#ifndef MAP2_CONFIG_SIM_STACK
+#define MAP2_CONFIG_SIM_STACK	(64 * 1024)
+#endif
+
+void os_mut_init(OS_ID mutex);
+OS_RESULT os_mut_wait(OS_ID mutex, U16 timeout);
+OS_RESULT os_mut_release(OS_ID mutex);
+OS_TID os_tsk_self(void);
+void os_tsk_pass(void);
+void os_dly_wait(U16 delay);
+U32 os_time_get(void);
+
+void map2_sim_init(void);
+OS_TID map2_sim_task(void (*fnc)(void *arg), void *arg, U8 prio);
+bool map2_sim_run(U32 until);
+
+#endif
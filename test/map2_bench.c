@@ -0,0 +1,407 @@
+/**
+	@file map2_bench.c
+	@brief Benchmark de latência do map2 no host
+	
+	Simula o laço de controle: uma tarefa escritora periódica por paridade de
+	canal (chaves pares e ímpares), leitores de alta taxa e um exportador que
+	lê todas as linhas periodicamente. Cada cenário executa nos modos de trava
+	mutex, fast e cell, com as mesmas tarefas e períodos.
+	
+	Para cada operação são exibidos a quantidade, os percentis p50/p99/p99.9
+	da latência (em nanossegundos, com a chave aguardada e liberada) e os
+	timeouts. Tarefas periódicas contabilizam uma perda de prazo quando o
+	ciclo termina depois do início do próximo ciclo.
+	
+	Uso:
+		map2_bench [-d ms] [-w us] [-r readers] [-p us] [-e ms] [-m mutex|fast|cell|all]
+		
+		-d	Duração de cada modo, padrão 2000 ms
+		-w	Período das escritoras, padrão 1000 us
+		-r	Quantidade de leitores, padrão 4
+		-p	Período dos leitores, 0 (padrão) lê continuamente
+		-e	Período do exportador, padrão 10 ms
+		-m	Modos de trava, padrão todos
+	
+	Os contadores de desempenho (map2_host_perf_*) de todas as tarefas do
+	cenário são exibidos por operação na linha 'perf' de cada modo, indicando
+	se o custo é de memória (faltas de cache) ou de sincronização (trocas de
+	contexto). Sem permissão para perf_event (perf_event_paranoid) a linha
+	indica 'unavailable'
+	
+	@note Os percentis têm erro de até 25% (MAP2_CONFIG_HIST_SUB), ver
+	map2_hist_quantile(..)
+*/
+
+#include "map2_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define BENCH_ROWS			(SLOT_CNT * SLOT_CH)
+#define BENCH_COLUMNS		(8)
+#define BENCH_READERS_MAX	(32)
+#define BENCH_TOUT			(100)
+
+typedef struct {
+	int32_t value;
+	uint32_t seq;
+	uint8_t data[24];
+}
+bench_item_t;
+
+MAP2(bench_item_t, bench_mutex, BENCH_ROWS, BENCH_COLUMNS, MAP2_NKEYS_2);
+MAP2_FAST(bench_item_t, bench_fast, BENCH_ROWS, BENCH_COLUMNS, MAP2_NKEYS_2);
+MAP2_CELL(bench_item_t, bench_cell, BENCH_ROWS, BENCH_COLUMNS);
+
+/**
+	Modos de trava medidos
+*/
+static const struct {
+	const char *name;
+	map2_t *map;
+}
+__bench_modes[] = {
+	{ "mutex", &bench_mutex },
+	{ "fast", &bench_fast },
+	{ "cell", &bench_cell },
+};
+
+#define BENCH_MODES		((int)(sizeof(__bench_modes) / sizeof(__bench_modes[0])))
+
+/**
+	Operações medidas
+	
+	@def BENCH_OP_WRITE Escrita de um item (map2_readwrite_try)
+	@def BENCH_OP_READ Leitura de um item (map2_readonly_try)
+	@def BENCH_OP_ROW Leitura de uma linha pelo exportador (map2_readonly_row_try)
+	@def BENCH_OP_SWEEP Leitura de todas as linhas pelo exportador
+*/
+typedef enum {
+	BENCH_OP_WRITE = 0,
+	BENCH_OP_READ,
+	BENCH_OP_ROW,
+	BENCH_OP_SWEEP,
+	BENCH_OP_COUNT,
+}
+bench_op_t;
+
+static const char *const __bench_op_names[BENCH_OP_COUNT] = { "write", "read", "row", "sweep" };
+
+/**
+	Resultado de uma operação, atualizado por várias tarefas
+*/
+typedef struct {
+	map2_hist_t latency;	/** Latência em nanossegundos */
+	uint64_t count;			/** Operações concluídas */
+	uint64_t timeouts;		/** Operações não alocadas */
+	uint64_t cycles;		/** Ciclos das tarefas periódicas */
+	uint64_t misses;		/** Ciclos que terminaram após o prazo */
+}
+bench_result_t;
+
+typedef struct {
+	uint32_t duration;		/** Duração de cada modo, em ms */
+	uint32_t writer;		/** Período das escritoras, em us */
+	int readers;			/** Quantidade de leitores */
+	uint32_t reader;		/** Período dos leitores, em us */
+	uint32_t exporter;		/** Período do exportador, em ms */
+}
+bench_config_t;
+
+typedef struct {
+	const map2_t *map;
+	const bench_config_t *cfg;
+	bench_result_t *result;
+	int index;				/** Paridade da escritora ou número do leitor */
+}
+bench_task_t;
+
+static bool __bench_stop;
+
+static uint64_t __bench_now(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void __bench_sleep_until(uint64_t ns) {
+	struct timespec ts = { (time_t)(ns / 1000000000u), (long)(ns % 1000000000u) };
+	
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/**
+	@brief Registra a latência de uma operação
+*/
+static void __bench_add(bench_result_t *r, uint64_t start, bool ok) {
+	uint64_t ns = __bench_now() - start;
+	
+	if (!ok) {
+		__atomic_fetch_add(&r->timeouts, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	
+	map2_hist_add(&r->latency, ns > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)ns);
+	__atomic_fetch_add(&r->count, 1, __ATOMIC_RELAXED);
+}
+
+/**
+	@brief Registra um ciclo de tarefa periódica
+	
+	@param deadline Início do próximo ciclo
+*/
+static void __bench_cycle(bench_result_t *r, uint64_t deadline) {
+	__atomic_fetch_add(&r->cycles, 1, __ATOMIC_RELAXED);
+	if (__bench_now() > deadline)
+		__atomic_fetch_add(&r->misses, 1, __ATOMIC_RELAXED);
+}
+
+/**
+	@brief Escritora periódica, atualiza todos os itens dos canais de uma
+	paridade a cada período
+*/
+static void *__bench_writer(void *arg) {
+	bench_task_t *t = arg;
+	const map2_t *m = t->map;
+	bench_result_t *r = &t->result[BENCH_OP_WRITE];
+	uint64_t period = (uint64_t)t->cfg->writer * 1000u;
+	uint64_t next = __bench_now();
+	uint32_t seq = 0;
+	
+	while (!__atomic_load_n(&__bench_stop, __ATOMIC_RELAXED)) {
+		next += period;
+		seq++;
+		
+		for (int row = t->index; row < m->rows; row += 2) {
+			int key = map2_key(m, row);
+			
+			for (int column = 0; column < m->columns; column++) {
+				bench_item_t *item = NULL;
+				uint64_t start = __bench_now();
+				bool ok = false;
+				
+				map2_readwrite_try(m, row, column, key, item, BENCH_TOUT, {
+					item->value = (int32_t)(seq * 31u + (uint32_t)column);
+					item->seq = seq;
+					ok = true;
+				});
+				__bench_add(r, start, ok);
+			}
+		}
+		
+		__bench_cycle(r, next);
+		__bench_sleep_until(next);
+	}
+	
+	return NULL;
+}
+
+/**
+	@brief Leitor de alta taxa, lê itens aleatórios continuamente ou a cada
+	período
+*/
+static void *__bench_reader(void *arg) {
+	bench_task_t *t = arg;
+	const map2_t *m = t->map;
+	bench_result_t *r = &t->result[BENCH_OP_READ];
+	uint64_t period = (uint64_t)t->cfg->reader * 1000u;
+	uint32_t rng = 0x9E3779B9u * (uint32_t)(t->index + 1);
+	uint64_t next = __bench_now();
+	
+	while (!__atomic_load_n(&__bench_stop, __ATOMIC_RELAXED)) {
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		
+		int row = (int)(rng % (uint32_t)m->rows);
+		int column = (int)((rng >> 16) % (uint32_t)m->columns);
+		bench_item_t item;
+		uint64_t start = __bench_now();
+		bool ok = false;
+		
+		map2_readonly_try(m, row, column, map2_key(m, row), item, BENCH_TOUT, {
+			ok = true;
+		});
+		__bench_add(r, start, ok);
+		
+		if (period != 0) {
+			next += period;
+			__bench_sleep_until(next);
+		}
+	}
+	
+	return NULL;
+}
+
+/**
+	@brief Exportador, lê todas as linhas do mapa a cada período
+*/
+static void *__bench_exporter(void *arg) {
+	bench_task_t *t = arg;
+	const map2_t *m = t->map;
+	uint64_t period = (uint64_t)t->cfg->exporter * 1000000u;
+	uint64_t next = __bench_now();
+	
+	while (!__atomic_load_n(&__bench_stop, __ATOMIC_RELAXED)) {
+		uint64_t sweep = __bench_now();
+		bool all = true;
+		
+		next += period;
+		
+		for (int row = 0; row < m->rows; row++) {
+			bench_item_t items[BENCH_COLUMNS];
+			uint64_t start = __bench_now();
+			bool ok = false;
+			
+			map2_readonly_row_try(m, row, map2_key(m, row), items, BENCH_TOUT, {
+				ok = true;
+			});
+			__bench_add(&t->result[BENCH_OP_ROW], start, ok);
+			all = all && ok;
+		}
+		
+		__bench_add(&t->result[BENCH_OP_SWEEP], sweep, all);
+		__bench_cycle(&t->result[BENCH_OP_SWEEP], next);
+		__bench_sleep_until(next);
+	}
+	
+	return NULL;
+}
+
+/**
+	@brief Exibe o resultado de um modo de trava
+*/
+static void __bench_report(const char *mode, const bench_result_t *result) {
+	for (int op = 0; op < BENCH_OP_COUNT; op++) {
+		const bench_result_t *r = &result[op];
+		char misses[32] = "-";
+		
+		if (r->cycles != 0)
+			snprintf(misses, sizeof(misses), "%llu/%llu", (unsigned long long)r->misses, (unsigned long long)r->cycles);
+		
+		printf("%-6s %-6s %10llu %10u %10u %10u %9llu %12s\n", mode, __bench_op_names[op],
+			(unsigned long long)r->count,
+			map2_hist_quantile(&r->latency, 1, 2),
+			map2_hist_quantile(&r->latency, 99, 100),
+			map2_hist_quantile(&r->latency, 999, 1000),
+			(unsigned long long)r->timeouts, misses);
+	}
+}
+
+/**
+	@brief Executa o cenário em um modo de trava
+	
+	@return true quando todas as tarefas foram criadas
+*/
+static bool __bench_run(int mode, const bench_config_t *cfg) {
+	static bench_result_t result[BENCH_OP_COUNT];
+	bench_task_t tasks[3 + BENCH_READERS_MAX];
+	pthread_t tid[3 + BENCH_READERS_MAX];
+	map2_t *m = __bench_modes[mode].map;
+	int n = 0;
+	
+	memset(result, 0, sizeof(result));
+	map2_init(m, {});
+	__atomic_store_n(&__bench_stop, false, __ATOMIC_RELAXED);
+	
+	// Os contadores incluem as tarefas criadas depois da abertura
+	map2_host_perf_t perf;
+	bool counters = map2_host_perf_open(&perf);
+	
+	map2_host_perf_start(&perf);
+	
+	for (int i = 0; i < 3 + cfg->readers; i++) {
+		void *(*fnc)(void *) = i < 2 ? __bench_writer : i == 2 ? __bench_exporter : __bench_reader;
+		
+		tasks[i] = (bench_task_t){ .map = m, .cfg = cfg, .result = result, .index = i < 2 ? i : i - 3 };
+		if (pthread_create(&tid[i], NULL, fnc, &tasks[i]) != 0)
+			break;
+		n++;
+	}
+	
+	if (n == 3 + cfg->readers)
+		usleep(cfg->duration * 1000u);
+	
+	__atomic_store_n(&__bench_stop, true, __ATOMIC_RELAXED);
+	
+	for (int i = 0; i < n; i++)
+		pthread_join(tid[i], NULL);
+	
+	map2_host_perf_stop(&perf);
+	
+	if (n != 3 + cfg->readers) {
+		fprintf(stderr, "pthread_create failed\n");
+		map2_host_perf_close(&perf);
+		return false;
+	}
+	
+	__bench_report(__bench_modes[mode].name, result);
+	
+	uint64_t ops = 0;
+	char text[256] = "unavailable";
+	
+	for (int op = 0; op < BENCH_OP_COUNT; op++)
+		ops += result[op].count;
+	
+	if (counters && ops != 0)
+		map2_host_perf_report(&perf, ops, text, sizeof(text));
+	
+	map2_host_perf_close(&perf);
+	printf("%-6s %-6s %s\n", __bench_modes[mode].name, "perf", text);
+	return true;
+}
+
+static void __bench_usage(const char *name) {
+	fprintf(stderr, "usage: %s [-d ms] [-w us] [-r readers] [-p us] [-e ms] [-m mutex|fast|cell|all]\n", name);
+}
+
+int main(int argc, char **argv) {
+	bench_config_t cfg = { .duration = 2000, .writer = 1000, .readers = 4, .reader = 0, .exporter = 10 };
+	const char *mode = "all";
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "d:w:r:p:e:m:h")) != -1) {
+		switch (opt) {
+			case 'd': cfg.duration = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'w': cfg.writer = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'r': cfg.readers = atoi(optarg); break;
+			case 'p': cfg.reader = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'e': cfg.exporter = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'm': mode = optarg; break;
+			default:
+				__bench_usage(argv[0]);
+				return 2;
+		}
+	}
+	
+	if (cfg.readers < 0 || cfg.readers > BENCH_READERS_MAX || cfg.writer == 0 || cfg.exporter == 0) {
+		__bench_usage(argv[0]);
+		return 2;
+	}
+	
+	printf("rows:%d columns:%d writers:2 period:%uus readers:%d period:%uus exporter:%ums duration:%ums\n",
+		BENCH_ROWS, BENCH_COLUMNS, cfg.writer, cfg.readers, cfg.reader, cfg.exporter, cfg.duration);
+	printf("%-6s %-6s %10s %10s %10s %10s %9s %12s\n", "mode", "op", "count", "p50(ns)", "p99(ns)", "p99.9(ns)", "timeouts", "misses");
+	
+	int ran = 0;
+	
+	for (int i = 0; i < BENCH_MODES; i++) {
+		if (strcmp(mode, "all") != 0 && strcmp(mode, __bench_modes[i].name) != 0)
+			continue;
+		if (!__bench_run(i, &cfg))
+			return 1;
+		ran++;
+	}
+	
+	if (ran == 0) {
+		__bench_usage(argv[0]);
+		return 2;
+	}
+	
+	return 0;
+}
@@ -0,0 +1,466 @@
+/**
+	@file map2_stress.c
+	@brief Teste de estresse do map2 no host
+	
+	Executa, de várias threads, uma mistura aleatória de leituras e escritas
+	de itens e de linhas, gather/scatter, escritas condicionais e leituras sem
+	trava (histórico, idade, amostras e registros) nos modos de trava mutex,
+	fast e cell.
+	
+	Cada item guarda uma soma de verificação, uma leitura com soma inválida
+	indica cópia parcial (torn read) ou exclusão mútua quebrada. Ao final o
+	contador de cada item é comparado com as escritas de todas as threads,
+	uma diferença indica escrita perdida.
+	
+	Uso:
+		map2_stress [-s seed] [-t threads] [-n ops] [-m mutex|fast|cell|all]
+	
+	A sequência de operações de cada thread é gerada a partir da semente e do
+	número da thread, a semente é exibida no início e em cada falha. Executar
+	novamente com os mesmos -s e -t repete as mesmas sequências, com -t 1 a
+	execução é totalmente determinística.
+	
+	Utilize 'make tsan' para executar com ThreadSanitizer, ver Makefile
+	
+	@return 0 quando não há falhas
+*/
+
+#include "map2.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define STRESS_ROWS			(16)
+#define STRESS_COLUMNS		(4)
+#define STRESS_VALUES		(6)
+#define STRESS_THREADS_MAX	(64)
+#define STRESS_TOUT			(1000)
+#define STRESS_BATCH		(4)
+
+/**
+	@def STRESS_SCATTER Coluna escrita apenas por scatter e write_changed, que
+	substituem o item inteiro. As demais colunas são apenas incrementadas,
+	permitindo verificar escritas perdidas
+*/
+#define STRESS_SCATTER		(STRESS_COLUMNS - 1)
+
+typedef struct {
+	uint32_t count;					/** Escritas no item */
+	uint32_t value[STRESS_VALUES];	/** Dados aleatórios */
+	uint32_t sum;					/** Soma de verificação */
+}
+stress_item_t;
+
+MAP2_HISTORY(stress_item_t, stress_mutex, STRESS_ROWS, STRESS_COLUMNS, MAP2_NKEYS_2, 8);
+MAP2_FAST(stress_item_t, stress_fast, STRESS_ROWS, STRESS_COLUMNS, MAP2_NKEYS_2);
+MAP2_CELL(stress_item_t, stress_cell, STRESS_ROWS, STRESS_COLUMNS);
+
+/**
+	Modos de trava testados
+*/
+static const struct {
+	const char *name;
+	map2_t *map;
+}
+__stress_modes[] = {
+	{ "mutex", &stress_mutex },
+	{ "fast", &stress_fast },
+	{ "cell", &stress_cell },
+};
+
+#define STRESS_MODES	((int)(sizeof(__stress_modes) / sizeof(__stress_modes[0])))
+
+/**
+	Operações executadas por cada thread
+*/
+typedef enum {
+	STRESS_OP_READONLY = 0,
+	STRESS_OP_READWRITE,
+	STRESS_OP_READONLY_ROW,
+	STRESS_OP_READWRITE_ROW,
+	STRESS_OP_GATHER,
+	STRESS_OP_SCATTER,
+	STRESS_OP_CHANGED,
+	STRESS_OP_LOCKFREE,
+	STRESS_OP_COUNT,
+}
+stress_op_t;
+
+static const char *const __stress_op_names[STRESS_OP_COUNT] = {
+	"readonly", "readwrite", "readonly_row", "readwrite_row",
+	"gather", "scatter", "write_changed", "lockfree",
+};
+
+/**
+	Peso de cada operação, em 1/100
+*/
+static const uint8_t __stress_op_weights[STRESS_OP_COUNT] = { 30, 25, 10, 8, 10, 5, 5, 7 };
+
+typedef struct {
+	int index;
+	int mode;
+	uint64_t rng;
+	uint32_t ops;
+	uint32_t timeouts;
+	uint32_t writes[STRESS_ROWS][STRESS_COLUMNS];
+}
+stress_thread_t;
+
+static uint64_t __stress_seed;
+static uint32_t __stress_failures;
+
+/**
+	@brief Gerador pseudoaleatório (splitmix64)
+*/
+static uint32_t __stress_rand(uint64_t *s) {
+	uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+	
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+/**
+	@brief Soma de verificação de um item (FNV-1a)
+*/
+static uint32_t __stress_sum(const stress_item_t *it) {
+	uint32_t h = 0x811C9DC5u ^ it->count;
+	
+	for (int i = 0; i < STRESS_VALUES; i++)
+		h = (h ^ it->value[i]) * 0x01000193u;
+	
+	return h;
+}
+
+/**
+	@brief Preenche o item com novos dados, mantendo a soma de verificação
+*/
+static void __stress_fill(stress_item_t *it, uint32_t count, uint64_t *rng) {
+	it->count = count;
+	for (int i = 0; i < STRESS_VALUES; i++)
+		it->value[i] = __stress_rand(rng);
+	it->sum = __stress_sum(it);
+}
+
+static void __stress_fail(const stress_thread_t *t, stress_op_t op, int row, int column, const char *what) {
+	if (__atomic_fetch_add(&__stress_failures, 1, __ATOMIC_RELAXED) < 16) {
+		fprintf(stderr, "FAIL %s: %s mode:%s thread:%d op:%u row:%d column:%d (replay: -s %llu)\n",
+			__stress_op_names[op], what, __stress_modes[t->mode].name, t->index, t->ops, row, column,
+			(unsigned long long)__stress_seed);
+	}
+}
+
+/**
+	@brief Verifica a soma de verificação de um item copiado
+*/
+static void __stress_check(const stress_thread_t *t, stress_op_t op, const stress_item_t *it, int row, int column) {
+	if (it->sum != __stress_sum(it))
+		__stress_fail(t, op, row, column, "torn read");
+}
+
+static stress_op_t __stress_pick(stress_thread_t *t) {
+	uint32_t r = __stress_rand(&t->rng) % 100;
+	
+	for (int op = 0; op < STRESS_OP_COUNT; op++) {
+		if (r < __stress_op_weights[op])
+			return (stress_op_t)op;
+		r -= __stress_op_weights[op];
+	}
+	
+	return STRESS_OP_READONLY;
+}
+
+/**
+	@brief Leituras sem trava: histórico, idade, amostras e registros
+*/
+static void __stress_lockfree(stress_thread_t *t, const map2_t *m, int row, int column) {
+	static __thread uint32_t sample_cursor, record_cursor;
+	stress_item_t values[8];
+	map2_sample_t samples[8];
+	map2_record_t records[8];
+	
+	if (m->history != NULL) {
+		int n = map2_history_read(m, row, column, NULL, values, 8);
+		
+		for (int i = 0; i < n; i++) {
+			__stress_check(t, STRESS_OP_LOCKFREE, &values[i], row, column);
+			
+			// Colunas apenas incrementadas, o histórico é crescente
+			if (column != STRESS_SCATTER && i > 0 && values[i].count <= values[i - 1].count)
+				__stress_fail(t, STRESS_OP_LOCKFREE, row, column, "history out of order");
+		}
+	}
+	
+	(void)map2_age(m, row, column);
+	
+	int n = map2_sample_read(&sample_cursor, samples, 8);
+	
+	for (int i = 0; i < n; i++) {
+		if (samples[i].map == NULL)
+			__stress_fail(t, STRESS_OP_LOCKFREE, samples[i].row, samples[i].column, "torn sample");
+	}
+	
+	(void)map2_record_read(&record_cursor, records, 8);
+}
+
+static void __stress_op(stress_thread_t *t, const map2_t *m, stress_op_t op) {
+	int row = (int)(__stress_rand(&t->rng) % STRESS_ROWS);
+	int column = (int)(__stress_rand(&t->rng) % STRESS_COLUMNS);
+	int key = map2_key(m, row);
+	bool ok = true;
+	
+	switch (op) {
+		case STRESS_OP_READONLY: {
+			stress_item_t it;
+			
+			ok = false;
+			map2_readonly_try(m, row, column, key, it, STRESS_TOUT, {
+				ok = true;
+				__stress_check(t, op, &it, row, column);
+			});
+			break;
+		}
+		
+		case STRESS_OP_READWRITE: {
+			stress_item_t *it = NULL;
+			
+			// A coluna de scatter não é incrementada
+			if (column == STRESS_SCATTER)
+				column = 0;
+			
+			ok = false;
+			map2_readwrite_try(m, row, column, key, it, STRESS_TOUT, {
+				ok = true;
+				__stress_check(t, op, it, row, column);
+				__stress_fill(it, it->count + 1, &t->rng);
+				t->writes[row][column]++;
+			});
+			break;
+		}
+		
+		case STRESS_OP_READONLY_ROW: {
+			stress_item_t r[STRESS_COLUMNS];
+			
+			ok = false;
+			map2_readonly_row_try(m, row, key, r, STRESS_TOUT, {
+				ok = true;
+				for (int c = 0; c < STRESS_COLUMNS; c++)
+					__stress_check(t, op, &r[c], row, c);
+			});
+			break;
+		}
+		
+		case STRESS_OP_READWRITE_ROW: {
+			stress_item_t *r = NULL;
+			
+			ok = false;
+			map2_readwrite_row_try(m, row, key, r, STRESS_TOUT, {
+				ok = true;
+				for (int c = 0; c < STRESS_SCATTER; c++) {
+					__stress_check(t, op, &r[c], row, c);
+					__stress_fill(&r[c], r[c].count + 1, &t->rng);
+					t->writes[row][c]++;
+				}
+			});
+			break;
+		}
+		
+		case STRESS_OP_GATHER: {
+			map2_cell_t cells[STRESS_BATCH];
+			stress_item_t items[STRESS_BATCH];
+			
+			for (int i = 0; i < STRESS_BATCH; i++) {
+				cells[i].row = (int)(__stress_rand(&t->rng) % STRESS_ROWS);
+				cells[i].column = (int)(__stress_rand(&t->rng) % STRESS_COLUMNS);
+			}
+			
+			memset(items, 0, sizeof(items));
+			for (int i = 0; i < STRESS_BATCH; i++)
+				items[i].sum = __stress_sum(&items[i]);
+			
+			ok = map2_gather(m, cells, STRESS_BATCH, items, STRESS_TOUT) == STRESS_BATCH;
+			for (int i = 0; i < STRESS_BATCH; i++)
+				__stress_check(t, op, &items[i], cells[i].row, cells[i].column);
+			break;
+		}
+		
+		case STRESS_OP_SCATTER: {
+			map2_cell_t cells[STRESS_BATCH];
+			stress_item_t items[STRESS_BATCH];
+			
+			for (int i = 0; i < STRESS_BATCH; i++) {
+				cells[i].row = (int)(__stress_rand(&t->rng) % STRESS_ROWS);
+				cells[i].column = STRESS_SCATTER;
+				__stress_fill(&items[i], __stress_rand(&t->rng), &t->rng);
+			}
+			
+			ok = map2_scatter(m, cells, STRESS_BATCH, items, STRESS_TOUT) == STRESS_BATCH;
+			break;
+		}
+		
+		case STRESS_OP_CHANGED: {
+			stress_item_t it;
+			
+			__stress_fill(&it, __stress_rand(&t->rng), &t->rng);
+			ok = map2_write_changed(m, row, STRESS_SCATTER, key, it, STRESS_TOUT) >= 0;
+			break;
+		}
+		
+		case STRESS_OP_LOCKFREE:
+		default:
+			__stress_lockfree(t, m, row, column);
+			break;
+	}
+	
+	if (!ok)
+		t->timeouts++;
+}
+
+static void *__stress_task(void *arg) {
+	stress_thread_t *t = arg;
+	const map2_t *m = __stress_modes[t->mode].map;
+	uint32_t n = t->ops;
+	
+	for (t->ops = 0; t->ops < n; t->ops++)
+		__stress_op(t, m, __stress_pick(t));
+	
+	return NULL;
+}
+
+/**
+	@brief Inicializa os itens com soma de verificação válida
+*/
+static void __stress_init(map2_t *m) {
+	map2_init(m, {
+		map2_unsafe_foreach(m, item, stress_item_t)
+			item->sum = __stress_sum(item);
+	});
+}
+
+/**
+	@brief Executa o teste em um modo de trava
+	
+	@param mode Posição em __stress_modes
+	@param seed Semente, cada thread utiliza a semente e o seu número
+	@param threads Quantidade de threads
+	@param ops Operações por thread
+	
+	@return Quantidade de falhas
+*/
+static uint32_t __stress_run(int mode, uint64_t seed, int threads, uint32_t ops) {
+	static stress_thread_t t[STRESS_THREADS_MAX];
+	pthread_t tid[STRESS_THREADS_MAX];
+	map2_t *m = __stress_modes[mode].map;
+	uint32_t failures = __atomic_load_n(&__stress_failures, __ATOMIC_RELAXED);
+	uint32_t timeouts = 0;
+	int created = 0;
+	
+	__stress_init(m);
+	
+	for (int i = 0; i < threads; i++) {
+		memset(&t[i], 0, sizeof(t[i]));
+		t[i].index = i;
+		t[i].mode = mode;
+		t[i].rng = seed ^ ((uint64_t)(i + 1) * 0xD1B54A32D192ED03ull);
+		t[i].ops = ops;
+		
+		if (pthread_create(&tid[i], NULL, __stress_task, &t[i]) != 0) {
+			fprintf(stderr, "pthread_create failed\n");
+			break;
+		}
+		created++;
+	}
+	
+	for (int i = 0; i < created; i++)
+		pthread_join(tid[i], NULL);
+	
+	// Escritas perdidas: o contador de cada item é a soma das escritas
+	for (int r = 0; r < STRESS_ROWS; r++) {
+		for (int c = 0; c < STRESS_SCATTER; c++) {
+			uint32_t expected = 0;
+			stress_item_t it;
+			
+			for (int i = 0; i < created; i++)
+				expected += t[i].writes[r][c];
+			
+			map2_readonly_try(m, r, c, map2_key(m, r), it, STRESS_TOUT, {
+				if (it.count != expected) {
+					fprintf(stderr, "FAIL lost update mode:%s row:%d column:%d count:%u expected:%u (replay: -s %llu)\n",
+						__stress_modes[mode].name, r, c, it.count, expected, (unsigned long long)seed);
+					__atomic_fetch_add(&__stress_failures, 1, __ATOMIC_RELAXED);
+				}
+			});
+		}
+	}
+	
+	for (int i = 0; i < created; i++)
+		timeouts += t[i].timeouts;
+	
+	if (created != threads)
+		__atomic_fetch_add(&__stress_failures, 1, __ATOMIC_RELAXED);
+	
+	failures = __atomic_load_n(&__stress_failures, __ATOMIC_RELAXED) - failures;
+	printf("%-6s threads:%d ops:%u timeouts:%u failures:%u\n", __stress_modes[mode].name, created, ops, timeouts, failures);
+	
+	return failures;
+}
+
+static void __stress_usage(const char *name) {
+	fprintf(stderr, "usage: %s [-s seed] [-t threads] [-n ops] [-m mutex|fast|cell|all]\n", name);
+}
+
+int main(int argc, char **argv) {
+	uint64_t seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+	int threads = 8;
+	uint32_t ops = 100000;
+	const char *mode = "all";
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "s:t:n:m:h")) != -1) {
+		switch (opt) {
+			case 's': seed = strtoull(optarg, NULL, 0); break;
+			case 't': threads = atoi(optarg); break;
+			case 'n': ops = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'm': mode = optarg; break;
+			default:
+				__stress_usage(argv[0]);
+				return 2;
+		}
+	}
+	
+	if (threads < 1 || threads > STRESS_THREADS_MAX) {
+		__stress_usage(argv[0]);
+		return 2;
+	}
+	
+	__stress_seed = seed;
+	printf("seed: %llu\n", (unsigned long long)seed);
+	
+	map2_sample_config(64, 0);
+	map2_record_enable(true);
+	
+	int ran = 0;
+	
+	for (int i = 0; i < STRESS_MODES; i++) {
+		if (strcmp(mode, "all") != 0 && strcmp(mode, __stress_modes[i].name) != 0)
+			continue;
+		__stress_run(i, seed, threads, ops);
+		ran++;
+	}
+	
+	if (ran == 0) {
+		__stress_usage(argv[0]);
+		return 2;
+	}
+	
+	uint32_t violations = map2_check_violations();
+	uint32_t failures = __atomic_load_n(&__stress_failures, __ATOMIC_RELAXED);
+	
+	printf("check violations:%u failures:%u\n", violations, failures);
+	
+	return failures == 0 && violations == 0 ? 0 : 1;
+}
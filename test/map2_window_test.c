@@ -0,0 +1,106 @@
+/**
+	@file map2_window_test.c
+	@brief Teste das estatísticas por janela (MAP2_WINDOW) no host
+	
+	Escreve valores em duas janelas consecutivas e verifica o mínimo e o
+	máximo lidos com map2_window_read(..), com valores apenas positivos,
+	apenas negativos e em uma única janela.
+	
+	Uso:
+		map2_window_test
+	
+	@return 0 quando não há falhas
+*/
+
+#include "map2.h"
+
+#include <stdio.h>
+
+/**
+	@def WINDOW_TICKS Duração da janela, em ticks (1 ms no host)
+*/
+#define WINDOW_TICKS	(20)
+
+typedef struct {
+	int32_t value;
+}
+window_item_t;
+
+MAP2_WINDOW(window_item_t, window_map, 4, 1, MAP2_NKEYS_1, value, WINDOW_TICKS, 2);
+
+static uint32_t __window_failures;
+
+/**
+	@brief Escreve os valores no item, na janela atual
+*/
+static void __window_write(int row, const int32_t *values, int n) {
+	for (int i = 0; i < n; i++) {
+		window_item_t it = { values[i] };
+		
+		if (map2_write_changed(&window_map, row, 0, map2_key(&window_map, row), it, 100) < 0) {
+			printf("row %d: write timeout\n", row);
+			__window_failures++;
+		}
+	}
+}
+
+/**
+	@brief Aguarda o início da próxima janela
+	
+	As janelas são alinhadas a múltiplos de WINDOW_TICKS, ver
+	__map2_window_roll(..)
+*/
+static void __window_next(void) {
+	uint32_t w = os_time_get() / WINDOW_TICKS;
+	
+	while (os_time_get() / WINDOW_TICKS == w)
+		os_dly_wait(1);
+}
+
+/**
+	@brief Verifica o mínimo, o máximo e o total de escritas de um item
+*/
+static void __window_check(const char *name, int row, int32_t min, int32_t max, uint32_t total) {
+	map2_window_stats_t s;
+	
+	if (!map2_window_read(&window_map, row, 0, &s)) {
+		printf("%s: no writes\n", name);
+		__window_failures++;
+		return;
+	}
+	
+	bool ok = s.min == min && s.max == max && s.total == total;
+	
+	printf("%s: min:%d max:%d total:%u %s\n", name, s.min, s.max, s.total, ok ? "ok" : "FAIL");
+	
+	if (!ok)
+		__window_failures++;
+}
+
+int main(void) {
+	static const int32_t pos[2][3] = { { 7, 5, 9 }, { 25, 20, 22 } };
+	static const int32_t neg[2][3] = { { -7, -5, -9 }, { -25, -20, -22 } };
+	static const int32_t mix[3] = { 3, -4, 8 };
+	
+	map2_init(&window_map, {});
+	
+	// A escrita e a leitura de cada caso ocorrem dentro da mesma janela
+	__window_next();
+	__window_write(0, pos[0], 3);
+	__window_write(1, neg[0], 3);
+	__window_next();
+	__window_write(0, pos[1], 3);
+	__window_write(1, neg[1], 3);
+	__window_check("positive", 0, 5, 25, 6);
+	__window_check("negative", 1, -25, -5, 6);
+	
+	__window_next();
+	__window_write(2, pos[1], 3);
+	__window_write(3, mix, 3);
+	__window_check("single", 2, 20, 25, 3);
+	__window_check("mixed", 3, -4, 8, 3);
+	
+	printf("failures:%u\n", __window_failures);
+	
+	return __window_failures == 0 ? 0 : 1;
+}
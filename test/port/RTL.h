@@ -0,0 +1,62 @@
+/**
+	@file RTL.h
+	@brief Header RTL (host)
+	
+	Subconjunto do RTX utilizado pelo map2, implementado com pthreads em
+	rtx.c, para compilar os testes de estresse e desempenho no host (Linux)
+	com threads reais, inclusive com ThreadSanitizer.
+	
+	Diferenças do RTX:
+		- Cada thread é uma tarefa, a identificação é atribuída no primeiro
+		acesso a os_tsk_self()
+		- Um tick dura MAP2_CONFIG_TICK_US (1 ms), os_time_get() utiliza
+		CLOCK_MONOTONIC
+		- Mutex recursivo, sem herança de prioridade
+	
+	@note Utilize map2_sim.h (MAP2_CONFIG_SIM) para reproduzir o escalonamento
+	do RTX com tempo virtual
+*/
+
+#ifndef __RTL_H__
+#define __RTL_H__
+
+#include <stdint.h>
+
+/**
+	Tipos e resultados do RTX
+*/
+typedef uint8_t U8;
+typedef uint16_t U16;
+typedef uint32_t U32;
+typedef void *OS_ID;
+typedef U32 OS_TID;
+typedef U32 OS_RESULT;
+typedef U32 OS_MUT[3];
+
+#define OS_R_OK		0
+#define OS_R_TMO	1
+#define OS_R_MUT	5
+#define OS_R_NOK	0xFF
+
+/**
+	Configuração da placa base utilizada pela política de chaves
+*/
+#ifndef SLOT_CNT
+#define SLOT_CNT		4
+#endif
+#ifndef SLOT_CH
+#define SLOT_CH			4
+#endif
+#ifndef UART_INSTANCES
+#define UART_INSTANCES	2
+#endif
+
+void os_mut_init(OS_ID mutex);
+OS_RESULT os_mut_wait(OS_ID mutex, U16 timeout);
+OS_RESULT os_mut_release(OS_ID mutex);
+OS_TID os_tsk_self(void);
+void os_tsk_pass(void);
+void os_dly_wait(U16 delay);
+U32 os_time_get(void);
+
+#endif
@@ -0,0 +1,100 @@
+#include <RTL.h>
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+/**
+	@def RTX_TICK_NS Duração de um tick, igual a MAP2_CONFIG_TICK_US
+*/
+#define RTX_TICK_NS		(1000000L)
+
+_Static_assert(sizeof(OS_MUT) >= sizeof(pthread_mutex_t*), "OS_MUT too small");
+
+static __thread OS_TID __rtx_self;
+static OS_TID __rtx_tasks;
+
+/**
+	@brief Mutex do sistema armazenado no OS_MUT
+*/
+static pthread_mutex_t *__rtx_mut(OS_ID mutex) {
+	return *(pthread_mutex_t**)mutex;
+}
+
+void os_mut_init(OS_ID mutex) {
+	pthread_mutex_t *mu = malloc(sizeof(*mu));
+	pthread_mutexattr_t attr;
+	
+	if (mu == NULL)
+		abort();
+	
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(mu, &attr);
+	pthread_mutexattr_destroy(&attr);
+	
+	*(pthread_mutex_t**)mutex = mu;
+}
+
+/**
+	@brief Aguarda o mutex
+	
+	@param timeout Timeout em ticks, 0xFFFF aguarda para sempre
+	
+	@return OS_R_OK quando o mutex foi alocado ou, OS_R_TMO no timeout
+*/
+OS_RESULT os_mut_wait(OS_ID mutex, U16 timeout) {
+	pthread_mutex_t *mu = __rtx_mut(mutex);
+	
+	if (timeout == 0xFFFF)
+		return pthread_mutex_lock(mu) == 0 ? OS_R_OK : OS_R_NOK;
+	
+	if (timeout == 0)
+		return pthread_mutex_trylock(mu) == 0 ? OS_R_OK : OS_R_TMO;
+	
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += (long)timeout * RTX_TICK_NS;
+	ts.tv_sec += ts.tv_nsec / 1000000000L;
+	ts.tv_nsec %= 1000000000L;
+	
+	return pthread_mutex_timedlock(mu, &ts) == 0 ? OS_R_OK : OS_R_TMO;
+}
+
+OS_RESULT os_mut_release(OS_ID mutex) {
+	return pthread_mutex_unlock(__rtx_mut(mutex)) == 0 ? OS_R_OK : OS_R_NOK;
+}
+
+/**
+	@return Identificação da thread atual, a partir de 1
+*/
+OS_TID os_tsk_self(void) {
+	if (__rtx_self == 0)
+		__rtx_self = __atomic_add_fetch(&__rtx_tasks, 1, __ATOMIC_RELAXED);
+	
+	return __rtx_self;
+}
+
+void os_tsk_pass(void) {
+	sched_yield();
+}
+
+void os_dly_wait(U16 delay) {
+	long ns = (long)delay * RTX_TICK_NS;
+	struct timespec ts = { ns / 1000000000L, ns % 1000000000L };
+	
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+/**
+	@return Instante atual em ticks
+*/
+U32 os_time_get(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (U32)((uint64_t)ts.tv_sec * (1000000000L / RTX_TICK_NS) + (uint64_t)ts.tv_nsec / RTX_TICK_NS);
+}
@@ -0,0 +1,18 @@
+/**
+	@file dbg.h
+	@brief Header dbg (host)
+	
+	Mensagens de debug dos testes no host. Desabilitadas por padrão, as
+	mensagens de cada acesso (MAP2_CONFIG_DBG_*) alteram os tempos medidos.
+	Compile com -DDBG_ENABLE para exibi-las em stderr
+*/
+
+#include <stdio.h>
+
+#undef dbgW
+
+#ifdef DBG_ENABLE
+#define dbgW(...)	fprintf(stderr, DBG_MODULE ": " __VA_ARGS__)
+#else
+#define dbgW(...)	((void)0)
+#endif